@@ -0,0 +1,78 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#include "NetThread/NetThreadSync.h"
+#include "NetThread/SegmentBuffer.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstring>
+
+// One thread writes messages into the buffer while another drains it, as an application queueing sends does against a stream
+// thread, returns the throughput in megabytes per second
+template<typename WriteFunction, typename ReadFunction>
+double measureBufferThroughput(size_t messageSize, size_t totalSize, WriteFunction write, ReadFunction read)
+{
+	std::atomic<size_t> consumed = 0;
+	Timer timer;
+	timer.start();
+	std::thread consumer([&]
+	{
+		std::vector<char> chunk(256 * 1024);
+		size_t total = 0;
+		while (total < totalSize)
+			total += read(chunk.data(), chunk.size());
+		consumed = total;
+	});
+	const std::string message(messageSize, 'x');
+	for (size_t written = 0; written < totalSize; written += messageSize)
+	{
+		while (not write(message.data(), messageSize))
+			std::this_thread::yield(); // full, waits for the consumer
+	}
+	consumer.join();
+	return (consumed / (1024.0 * 1024.0)) / timer.getElapsed();
+}
+
+// Compares the locked send and receive buffer streams used before against the lock-free segment buffer they use now
+// for message sizes ranging from small requests to full TLS records
+int bufferBenchmark()
+{
+	constexpr size_t totalSize = 512 * 1024 * 1024;
+	for (size_t messageSize : { 64, 512, 1460, 16384 })
+	{
+		NetBufferAdvanced buffer{ 2048 };
+		const double lockedRate = measureBufferThroughput(messageSize, totalSize,
+			[&](const char* data, size_t size)
+			{
+				NetBufferAdvanced::Lock lock;
+				char* dst = buffer.getBufferForWrite(lock, size);
+				memcpy(dst, data, size);
+				buffer.written(size);
+				return true;
+			},
+			[&](char* dst, size_t maxSize)
+			{
+				NetBufferAdvanced::Lock lock;
+				size_t readable = 0;
+				const char* src = buffer.getBufferForRead(lock, readable);
+				readable = ESMin(readable, maxSize);
+				if (readable)
+				{
+					memcpy(dst, src, readable);
+					buffer.read(readable);
+				}
+				return readable;
+			});
+
+		SegmentBuffer segments{ 2048 };
+		const double segmentRate = measureBufferThroughput(messageSize, totalSize,
+			[&](const char* data, size_t size) { return segments.write(data, size); },
+			[&](char* dst, size_t maxSize) { return segments.read(dst, maxSize); });
+
+		std::cout << "\n" << messageSize << " byte messages: NetBufferAdvanced " << (size_t)lockedRate << " MB/s, SegmentBuffer "
+				  << (size_t)segmentRate << " MB/s";
+	}
+	std::cout << std::endl;
+	return 0;
+}
@@ -0,0 +1,66 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#include "NetThread/NetThreadSync.h"
+#include "NetThread/BufferPool.h"
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <cstring>
+
+// Several threads open and close connections as a server under churn does, each connection allocates its send and receive
+// buffers, grows them twice as a request and response arrive, and allocates the input and output buffers of a TLS session
+// returns the time taken in milliseconds
+template<typename AllocateFunction, typename FreeFunction>
+double measureConnectionChurn(size_t numThreads, size_t connectionsPerThread, AllocateFunction allocate, FreeFunction free)
+{
+	constexpr size_t sizes[] = { 2048, 2048, 4096, 4096, 8192, 8192, 16709, 16469 };
+	Timer timer;
+	timer.start();
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < numThreads; t++)
+	{
+		threads.emplace_back([&]
+		{
+			std::vector<char*> open;
+			for (size_t connection = 0; connection < connectionsPerThread; connection++)
+			{
+				for (size_t size : sizes)
+				{
+					open.push_back(allocate(size));
+					memset(open.back(), 0x01, 64); // touched, as the first bytes of a message would be
+				}
+				// a few connections stay open at a time
+				if (open.size() >= 16 * std::size(sizes))
+				{
+					for (size_t i = 0; i < open.size(); i++)
+						free(open[i], sizes[i % std::size(sizes)]);
+					open.clear();
+				}
+			}
+			for (size_t i = 0; i < open.size(); i++)
+				free(open[i], sizes[i % std::size(sizes)]);
+		});
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+	return timer.getElapsedMs();
+}
+
+// Compares the global allocator the buffers of connections were allocated with until now against the size-class pool
+int bufferPoolBenchmark()
+{
+	constexpr size_t connectionsPerThread = 500000;
+	for (size_t numThreads : { 1, 4, 16 })
+	{
+		const double heapMs = measureConnectionChurn(numThreads, connectionsPerThread,
+			[](size_t size) { return new char[size]; },
+			[](char* block, size_t) { delete[] block; });
+		const double poolMs = measureConnectionChurn(numThreads, connectionsPerThread,
+			[](size_t size) { return BufferPool::allocate(size); },
+			[](char* block, size_t size) { BufferPool::deallocate(block, size); });
+		std::cout << "\n" << numThreads << " threads: new/delete " << heapMs << " ms, pool " << poolMs << " ms";
+	}
+	const BufferPool::Stats stats = BufferPool::getStats();
+	std::cout << "\nPool: " << stats.threadCacheHits << " thread cache hits, " << stats.sharedHits << " shared hits, " << stats.misses
+			  << " misses, " << stats.slabBytes / 1024 << " KiB of slabs, " << stats.bytesInUse << " bytes in use" << std::endl;
+	return 0;
+}
@@ -0,0 +1,90 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#include "NetThread/NetThreadSync.h"
+#include "NetThread/SlotMap.h"
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <random>
+#include <algorithm>
+#include <cstdint>
+
+// stands in for a Connection, which is a shared handle to its stream and an id
+struct RegistryBenchmarkEntry
+{
+	std::shared_ptr<int> stream;
+	uint64_t id = 0;
+};
+
+// Churns a registry of open connections as a busy server does, each round a random connection closes and a new one is
+// accepted, the connection receiving data is looked up by id, and every connection is visited once per sweep
+// returns the time taken in milliseconds
+template<typename InsertFunction, typename FindFunction, typename RemoveFunction, typename VisitFunction>
+double measureRegistryChurn(size_t numConnections, size_t numRounds, InsertFunction insert, FindFunction find,
+							RemoveFunction remove, VisitFunction visitAll)
+{
+	std::mt19937_64 rng{ 12345 };
+	std::vector<uint64_t> open;
+	open.reserve(numConnections);
+	for (size_t i = 0; i < numConnections; i++)
+		open.push_back(insert());
+
+	Timer timer;
+	timer.start();
+	size_t found = 0;
+	for (size_t round = 0; round < numRounds; round++)
+	{
+		const size_t closing = rng() % open.size();
+		remove(open[closing]);
+		open[closing] = insert();
+		for (int lookup = 0; lookup < 8; lookup++)
+			found += find(open[rng() % open.size()]) ? 1 : 0;
+		if (round % 1000 == 0)
+			visitAll(); // a sweep like HttpServer::handleRequests polling every connection
+	}
+	const double elapsedMs = timer.getElapsedMs();
+	if (found != numRounds * 8)
+		std::cout << "\nLookups failed: " << numRounds * 8 - found;
+	return elapsedMs;
+}
+
+// Compares the sorted vector connections were registered in until now, where removal shifts every later connection,
+// against the generational slot map, at 100k open connections
+int connectionRegistryBenchmark()
+{
+	constexpr size_t numConnections = 100000;
+	constexpr size_t numRounds = 100000;
+	size_t visited = 0;
+
+	std::vector<RegistryBenchmarkEntry> sorted;
+	uint64_t idCounter = 0;
+	const double sortedMs = measureRegistryChurn(numConnections, numRounds,
+		[&]
+		{
+			sorted.push_back(RegistryBenchmarkEntry{ std::make_shared<int>(0), idCounter });
+			return idCounter++;
+		},
+		[&](uint64_t id)
+		{
+			auto it = std::lower_bound(sorted.begin(), sorted.end(), id,
+									   [](const RegistryBenchmarkEntry& e, uint64_t value) { return e.id < value; });
+			return it != sorted.end() and it->id == id;
+		},
+		[&](uint64_t id)
+		{
+			auto it = std::lower_bound(sorted.begin(), sorted.end(), id,
+									   [](const RegistryBenchmarkEntry& e, uint64_t value) { return e.id < value; });
+			sorted.erase(it);
+		},
+		[&] { for (const auto& entry : sorted) visited += *entry.stream; });
+
+	SlotMap<RegistryBenchmarkEntry> slotMap;
+	const double slotMapMs = measureRegistryChurn(numConnections, numRounds,
+		[&] { return slotMap.insert(RegistryBenchmarkEntry{ std::make_shared<int>(0), slotMap.nextKey() }); },
+		[&](uint64_t id) { return slotMap.find(id) != nullptr; },
+		[&](uint64_t id) { slotMap.erase(id); },
+		[&] { for (const auto& entry : slotMap.all()) visited += *entry.stream; });
+
+	std::cout << "\n" << numRounds << " rounds of churn at " << numConnections << " connections: sorted vector " << sortedMs
+			  << " ms, slot map " << slotMapMs << " ms" << std::endl;
+	return (int)visited;
+}
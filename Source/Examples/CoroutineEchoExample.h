@@ -0,0 +1,46 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#include "NetAgent/Agent.h"
+#include "NetThread/Coroutines.h"
+#include <iostream>
+#include <string>
+#include <optional>
+
+// Echoes every message back to the client which sent it, each client is served by its own coroutine
+NetTask<void> echoClient(Connection connection)
+{
+	while (true)
+	{
+		// suspends until data arrives, without polling or sleeping
+		std::string message = co_await connection.receiveAtLeast(1);
+		if (message.empty())
+			co_return; // the client disconnected
+		if (not co_await connection.sendAll(std::move(message)))
+			co_return;
+	}
+}
+
+NetTask<void> acceptClients(Agent& agent, CoroutineScheduler& scheduler)
+{
+	while (std::optional<Connection> connection = co_await agent.accept())
+	{
+		std::cout << "\nClient connected";
+		scheduler.spawn(echoClient(*connection));
+	}
+}
+
+// Runs an echo server written as sequential code with coroutines
+// Test by connecting with any TCP client, such as "nc 127.0.0.1 5002", and typing messages
+int coroutineEchoExample()
+{
+	Agent agent{ Agent::Mode::Server };
+	NetAgentSettings settings;
+	settings.threadingModel = NetThreadingModel::EventLoop;
+	agent.applySettings(settings);
+	agent.listen("5002", "127.0.0.1");
+
+	// the coroutines run on this thread, they are resumed whenever the connections they wait on have activity
+	CoroutineScheduler scheduler;
+	scheduler.spawn(acceptClients(agent, scheduler));
+	scheduler.run();
+	return 0;
+}
@@ -45,11 +45,12 @@ int simpleHttpServerExample(const std::string& htmlFilePath, const std::string&
 	while (agent.updateConnections() and agent.numConnections() == 0)
 		Sockets::threadSleep(300);;
 	std::cout << "\nClient connected";
+	Connection connection = agent.getAllConnections()[0];
 
 	for (;;)
 	{
 		std::string incoming;
-		agent.getConnection(0).receive(incoming);
+		connection.receive(incoming);
 		if (not incoming.empty())
 		{
 			std::cout << "\nReceived message from client:\n" << incoming;
@@ -69,7 +70,7 @@ int simpleHttpServerExample(const std::string& htmlFilePath, const std::string&
 			}
 			
 			std::cout << "\nReplied:\n" << response << "\n";
-			agent.getConnection(0).send(response);
+			connection.send(response);
 			
 			//break;
 		}
@@ -61,16 +61,17 @@ int tcpChatExample()
 	std::cout << "\nLeave message blank and press enter to receive, or enter a message to send\n";
 	for (;;)
 	{
-		auto numConn = agent.numConnections();
 		// receive
 		std::string instr;
-		for (size_t i = 0; i < numConn; i++)
+		size_t clientNumber = 0;
+		for (Connection& connection : agent.getAllConnections())
 		{
 			std::string rstr;
-			agent.getConnection(i).receive(rstr);
+			connection.receive(rstr);
+			clientNumber++;
 			if (!rstr.empty())
 			{
-				if (agent.isServer()) { instr += "\nClient " + std::to_string(i + 1); }
+				if (agent.isServer()) { instr += "\nClient " + std::to_string(clientNumber); }
 				else { instr += "\nServer"; }
 				instr += +": " + rstr;
 			}
@@ -82,11 +83,10 @@ int tcpChatExample()
 		std::getline(std::cin, msg);
 		if (!msg.empty())
 		{
-			numConn = agent.numConnections();
-			for (size_t i = 0; i < numConn; i++)
+			for (Connection& connection : agent.getAllConnections())
 			{
 				bool sendSuccess = false;
-				while (!sendSuccess) { sendSuccess = agent.getConnection(i).send(msg); }
+				while (!sendSuccess) { sendSuccess = connection.send(msg); }
 			}
 		}
 
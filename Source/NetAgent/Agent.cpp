@@ -2,15 +2,48 @@
 #include "NetAgent/Agent.h"
 #include "NetThread/StreamThread.h"
 #include "NetThread/ListenThread.h"
+#include "NetThread/EpollLoopThread.h"
+#include "NetThread/IoUringLoopThread.h"
+#include "NetThread/ThreadPlacement.h"
 #include "Sockets/Sockets.h"
 #include "NetAgent/HttpServerUtils/Logging.h"
 #include <algorithm>
 
+#ifndef _WIN32
+	#include <poll.h>
+#endif
+
+namespace
+{
+	// creates and starts the event loop for a threading model, falling back to simpler loops, returns nullptr if none is available
+	// the loop thread is pinned to the core unless it is negative
+	std::unique_ptr<EventLoopThread> createEventLoop(NetThreadingModel model, int core)
+	{
+		std::unique_ptr<EventLoopThread> eventLoop = nullptr;
+		if (model == NetThreadingModel::IoUring and IoUringLoopThread::isSupported())
+		{
+			eventLoop = std::make_unique<IoUringLoopThread>();
+			eventLoop->setCore(core);
+			if (not eventLoop->start())
+				eventLoop = nullptr;
+			if (not eventLoop)
+				ESLog::es_warning("io_uring is not available, using epoll event loop instead");
+		}
+		if (not eventLoop and EpollLoopThread::isSupported())
+		{
+			eventLoop = std::make_unique<EpollLoopThread>();
+			eventLoop->setCore(core);
+			if (not eventLoop->start())
+				eventLoop = nullptr;
+		}
+		return eventLoop;
+	}
+}
+
 Agent::Agent(Mode mode)
 	: mode{ mode }
 {
 	Sockets::init();
-	listenThread = (mode != Mode::Client) ? std::make_unique<ListenThread>() : nullptr;
 }
 
 Agent::~Agent()
@@ -24,8 +57,41 @@ Connection& Agent::connect(std::string_view hostname, std::string_view port)
 	if (not settings)
 		applySettings(NetAgentSettings());
 	// client mode only
-	connections.push_back(Connection(hostname, port, settings, connectionIdCounter++));
-	return connections.back();
+	startEventLoops();
+	const ConnectionId id = connections.insert(Connection(hostname, port, settings, connections.nextKey(), &getResolver(),
+																 getLeastLoadedEventLoop()));
+	return *connections.find(id);
+}
+
+Resolver& Agent::getResolver()
+{
+	if (not settings)
+		applySettings(NetAgentSettings());
+	if (not resolver)
+		resolver = std::make_unique<Resolver>(settings);
+	return *resolver;
+}
+
+ConnectionPool& Agent::getConnectionPool()
+{
+	if (not connectionPool)
+	{
+		Resolver* poolResolver = &getResolver();
+		startEventLoops(); // the pool connects from other threads, the workers must not be started lazily from there
+		connectionPool = std::make_unique<ConnectionPool>(settings, [this, poolResolver](std::string_view hostname, std::string_view port)
+		{
+			return std::make_unique<Connection>(hostname, port, settings, connectionIdCounter++, poolResolver, getLeastLoadedEventLoop());
+		});
+	}
+	return *connectionPool;
+}
+
+std::string Agent::getSocketTuningReport() const
+{
+	std::string report;
+	for (size_t i = 0; i < listenThreads.size(); i++)
+		report += (i > 0 ? "\n" : "") + listenThreads[i]->getTuningReport();
+	return report;
 }
 
 void Agent::listen(std::string_view port, std::string_view hostname)
@@ -34,25 +100,83 @@ void Agent::listen(std::string_view port, std::string_view hostname)
 	// apply default server settings if not set
 	if (not settings)
 		applySettings(NetAgentSettings());
-	// start listen thread to begin accepting connections
-	listenThread->start(port, hostname);
+	if (not listenThreads.empty())
+		return; // already listening
+
+	size_t numShards = (settings->listenShards > 0) ? settings->listenShards : ESMax(std::thread::hardware_concurrency(), 1u);
+	if (numShards > 1 and not Sockets::reusePortSupported())
+	{
+		ESLog::es_warning("SO_REUSEPORT is not available, using a single listen socket");
+		numShards = 1;
+	}
+	if (Sockets::isUnixAddress(hostname))
+		numShards = 1; // unix domain sockets cannot share a path
+
+	// start the event loops first, so they are ready to service the first accepted connection
+	startEventLoops();
+
+	// start listen threads to begin accepting connections
+	for (size_t i = 0; i < numShards; i++)
+	{
+		auto& listenThread = listenThreads.emplace_back(std::make_unique<ListenThread>());
+		listenThread->updateSettings(settings);
+		const int core = settings->listenCores.empty() ? -1 : settings->listenCores[i % settings->listenCores.size()];
+		listenThread->start(port, hostname, getShardEventLoop(i), (numShards > 1), core);
+	}
 }
 
 void Agent::stopListening()
 { 
 	assert(isServer());
-	listenThread->stop(); 
+	for (auto& listenThread : listenThreads)
+		listenThread->stop();
 }
 
-Connection& Agent::getConnection(ConnectionId id)
-{ 
-	for (auto& conn : connections)
+NetTask<std::optional<Connection>> Agent::accept()
+{
+	assert(isServer());
+	acceptQueueEnabled = true;
+	auto isListening = [this]
 	{
-		if (conn.id == id)
-			return conn;
+		return std::any_of(listenThreads.begin(), listenThreads.end(), [](const auto& l) { return not l->isStopped(); });
+	};
+	while (true)
+	{
+		updateConnections();
+		if (not acceptedConnections.empty())
+		{
+			Connection connection = std::move(acceptedConnections.front());
+			acceptedConnections.pop_front();
+			co_return connection;
+		}
+		if (not isListening())
+			co_return std::nullopt;
+		co_await ActivityAwaiter(
+			[this](std::function<void()> callback) 
+			{ 
+				for (auto& listenThread : listenThreads) 
+					listenThread->setReadyCallback(callback); 
+			},
+			[this, isListening]
+			{
+				return not isListening() or std::any_of(listenThreads.begin(), listenThreads.end(), 
+														[](const auto& l) { return l->hasConnectedSockets(); });
+			});
 	}
 }
 
+Connection& Agent::getConnection(ConnectionId id)
+{ 
+	Connection* conn = findConnection(id);
+	assert(conn && "no connection with this id");
+	return *conn;
+}
+
+Connection* Agent::findConnection(ConnectionId id)
+{
+	return connections.find(id);
+}
+
 size_t Agent::numConnections() const
 {
 	return connections.size();
@@ -63,36 +187,144 @@ bool Agent::updateConnections()
 	assert(isServer() && "do not call updateConnections when in client mode");
 	if (not isServer())
 		return false;
-	auto sockets = listenThread->getConnectedSockets();
-	for (SOCKET socket : sockets)
-	{ 
-		if (connections.size() < settings->connectionsMax)
-			connections.push_back(Connection(socket, (mode == Agent::Mode::ServerEncrypted), settings, connectionIdCounter++));
-		else
+	for (size_t shard = 0; shard < listenThreads.size(); shard++)
+	{
+		auto sockets = listenThreads[shard]->getConnectedSockets();
+		for (SOCKET socket : sockets)
+		{ 
+			if (connections.size() < settings->connectionsMax)
+			{
+				// connections steered by incoming core stay on the worker of that core, the others go where there is room
+				EventLoopThread* eventLoop = settings->steerToIncomingCpu ? getShardEventLoop(shard) : getLeastLoadedEventLoop();
+				const ConnectionId id = connections.insert(Connection(socket, (mode == Agent::Mode::ServerEncrypted), settings,
+																	  connections.nextKey(), eventLoop));
+				if (acceptQueueEnabled)
+					acceptedConnections.push_back(*connections.find(id));
+			}
+			else
+			{
+				// drop connections if limit is exceeded, telling the peer why is best effort since the socket does not block
+				if (not connectionLimitResponse.empty())
+					Sockets::sendData(socket, connectionLimitResponse.data(), connectionLimitResponse.size());
+				Sockets::shutdownConnection(socket, 2);
+				Sockets::closeSocket(socket);
+				ESLog::es_detail("Connection limit exceeded, dropped connection");
+			}
+		}
+	}
+	connections.eraseIf([this](const Connection& connection)
+	{
+		if (not connection.isFailed() and connection.isConnected())
+			return false;
+		ESLog::es_detail(ESLog::FormatStr() << "Connection " << connection.id << " removed, " << connections.size() - 1 << " active");
+		return true;
+	});
+
+	return true;
+}
+
+void Agent::waitForConnections(int timeoutMs)
+{
+	assert(isServer());
+#ifndef _WIN32
+	std::vector<pollfd> fds;
+	for (auto& listenThread : listenThreads)
+	{
+		if (listenThread->getReadyNotifyFd() != -1)
+			fds.push_back(pollfd{ .fd = listenThread->getReadyNotifyFd(), .events = POLLIN, .revents = 0 });
+	}
+	if (not fds.empty() and fds.size() == listenThreads.size())
+	{
+		poll(fds.data(), fds.size(), timeoutMs);
+		return;
+	}
+#endif
+	Sockets::threadSleep(timeoutMs); // no readiness notification on this platform
+}
+
+bool Agent::openDatagram(std::string_view port, std::string_view hostname)
+{
+	assert(mode == Mode::Datagram);
+	if (not settings)
+		applySettings(NetAgentSettings());
+	if (datagramThread)
+		return true; // already open
+	auto thread = std::make_unique<DatagramThread>();
+	if (not thread->start(port, hostname, settings))
+		return false;
+	datagramThread = std::move(thread);
+	return true;
+}
+
+size_t Agent::receiveDatagrams(const std::function<void(const Datagram&)>& handler, size_t maxCount)
+{
+	assert(mode == Mode::Datagram);
+	return datagramThread ? datagramThread->receive(handler, maxCount) : 0;
+}
+
+bool Agent::sendDatagram(const Sockets::SocketAddress& to, std::string_view data, size_t segmentSize)
+{
+	assert(mode == Mode::Datagram);
+	return datagramThread and datagramThread->send(to, data, segmentSize);
+}
+
+void Agent::startEventLoops()
+{
+	if (eventLoopsStarted)
+		return;
+	eventLoopsStarted = true;
+	if (settings->threadingModel == NetThreadingModel::ThreadPerConnection)
+		return;
+	const size_t numWorkers = (settings->eventLoopWorkers > 0) ? settings->eventLoopWorkers 
+															   : ESMax(std::thread::hardware_concurrency(), 1u);
+	for (size_t i = 0; i < numWorkers; i++)
+	{
+		const int core = settings->workerCores.empty() ? -1 : settings->workerCores[i % settings->workerCores.size()];
+		auto eventLoop = createEventLoop(settings->threadingModel, core);
+		if (not eventLoop)
 		{
-			Sockets::shutdownConnection(socket, 2); // drop connections if limit is exceeded
-			ESLog::es_detail("Connection limit exceeded, dropped connection");
+			ESLog::es_warning("Event loop is not available, using one thread per connection instead");
+			eventLoops.clear();
+			return;
 		}
+		eventLoops.push_back(std::move(eventLoop));
 	}
-	for (auto it = connections.begin(); it != connections.end();)
+}
+
+EventLoopThread* Agent::getLeastLoadedEventLoop() const
+{
+	EventLoopThread* leastLoaded = nullptr;
+	size_t leastStreams = SIZE_MAX;
+	for (const auto& eventLoop : eventLoops)
 	{
-		if (it->isFailed() || !it->isConnected()) 
+		const size_t numStreams = eventLoop->numStreams();
+		if (numStreams < leastStreams)
 		{
-			ESLog::es_detail(ESLog::FormatStr() << "Connection " << it->id << " removed, " << connections.size() << " active");
-			it = connections.erase(it);
+			leastLoaded = eventLoop.get();
+			leastStreams = numStreams;
 		}
-		else 
+	}
+	return leastLoaded;
+}
+
+EventLoopThread* Agent::getShardEventLoop(size_t shard) const
+{
+	if (settings->steerToIncomingCpu and not settings->listenCores.empty())
+	{
+		// the worker pinned to the shard's core, connections steered to the shard arrive on that core
+		const int core = settings->listenCores[shard % settings->listenCores.size()];
+		for (const auto& eventLoop : eventLoops)
 		{
-			++it;
+			if (eventLoop->getCore() == core)
+				return eventLoop.get();
 		}
 	}
-	
-	return true;
+	return eventLoops.empty() ? nullptr : eventLoops[shard % eventLoops.size()].get();
 }
 
-std::vector<Connection>& Agent::getAllConnections()
+std::span<Connection> Agent::getAllConnections()
 {
-	return connections;
+	return connections.all();
 }
 
 void Agent::applySettings(const NetAgentSettings& settingsNew)
@@ -100,21 +332,25 @@ void Agent::applySettings(const NetAgentSettings& settingsNew)
 	settings = std::make_shared<NetAgentSettings>(settingsNew);
 }
 
-Connection::Connection(SOCKET connectedSocket, bool useEncryption, const std::shared_ptr<NetAgentSettings>& settings, ConnectionId id)
-	: thread{ std::make_unique<StreamThread>(2048, 2048, 
-		useEncryption ? StreamEncryptionMode::Encrypted : StreamEncryptionMode::NoEncryption) },
-	id{ id }
+Connection::Connection(SOCKET connectedSocket, bool useEncryption, const std::shared_ptr<NetAgentSettings>& settings, ConnectionId id,
+						EventLoopThread* eventLoop)
+	: id{ id }
 {
+	// allocated on the memory node of the worker which will service the connection, the pool hands out blocks of that node
+	ThreadPlacement::ScopedNumaPreference preference{ eventLoop ? eventLoop->getNumaNode() : -1 };
+	thread = std::make_shared<StreamThread>(2048, 2048, useEncryption ? StreamEncryptionMode::Encrypted : StreamEncryptionMode::NoEncryption);
 	thread->updateSettings(settings);
-	thread->start(connectedSocket);
+	thread->start(connectedSocket, eventLoop);
 }
 
-Connection::Connection(std::string_view hostname, std::string_view port, const std::shared_ptr<NetAgentSettings>& settings, ConnectionId id)
-	: thread{ std::make_unique<StreamThread>(256, 256, StreamEncryptionMode::NoEncryption) },
-	id{ id }
+Connection::Connection(std::string_view hostname, std::string_view port, const std::shared_ptr<NetAgentSettings>& settings, ConnectionId id,
+						Resolver* resolver, EventLoopThread* eventLoop)
+	: id{ id }
 {
+	ThreadPlacement::ScopedNumaPreference preference{ eventLoop ? eventLoop->getNumaNode() : -1 };
+	thread = std::make_shared<StreamThread>(256, 256, StreamEncryptionMode::NoEncryption);
 	thread->updateSettings(settings);
-	thread->start(hostname, port);
+	thread->start(hostname, port, resolver, eventLoop);
 }
 
 bool Connection::isConnected() const 
@@ -127,6 +363,11 @@ bool Connection::isFailed() const
 	return thread->isFailed(); 
 }
 
+bool Connection::isConnecting() const
+{
+	return thread->isConnecting();
+}
+
 void Connection::Close() 
 { 
 	thread->stop(); 
@@ -137,6 +378,26 @@ bool Connection::send(std::string_view data)
 	return thread->queueSend(data); 
 }
 
+size_t Connection::trySend(std::string_view data)
+{
+	return thread->queueSendPartial(data);
+}
+
+bool Connection::isWritable() const
+{
+	return thread->isWritable();
+}
+
+void Connection::setWritableCallback(std::function<void()> callback)
+{
+	thread->setWritableCallback(std::move(callback));
+}
+
+bool Connection::sendSegments(std::vector<SendSegment> segments)
+{
+	return thread->queueSendSegments(std::move(segments));
+}
+
 void Connection::receive(std::string& data) 
 { 
 	thread->getReceiveBuffer(data); 
@@ -148,3 +409,64 @@ size_t Connection::getIncomingDataSize() const
 {
 	return thread->getReceiveDataSize();
 }
+
+size_t Connection::getOutgoingDataSize() const
+{
+	return thread->getSendPendingSize();
+}
+
+void Connection::setActivityCallback(std::function<void()> callback)
+{
+	thread->setActivityCallback(std::move(callback));
+}
+
+// the operations run on a copy of the connection, which stays valid while suspended even if the original handle moves
+namespace
+{
+	bool connectionEnded(const Connection& connection)
+	{
+		return connection.isFailed() or (not connection.isConnected() and not connection.isConnecting());
+	}
+
+	ActivityAwaiter connectionActivity(Connection& connection, std::function<bool()> condition)
+	{
+		return ActivityAwaiter([&connection](std::function<void()> callback) { connection.setActivityCallback(std::move(callback)); },
+							   std::move(condition));
+	}
+
+	NetTask<std::string> receiveAtLeastTask(Connection connection, size_t minSize)
+	{
+		while (connection.getIncomingDataSize() < minSize and not connectionEnded(connection))
+		{
+			co_await connectionActivity(connection, [&connection, minSize]
+				{ return connection.getIncomingDataSize() >= minSize or connectionEnded(connection); });
+		}
+		std::string data;
+		connection.receive(data);
+		co_return data;
+	}
+
+	NetTask<bool> sendAllTask(Connection connection, std::string data)
+	{
+		if (not data.empty() and not connection.send(data))
+			co_return false;
+		while (connection.getOutgoingDataSize() > 0)
+		{
+			if (connectionEnded(connection))
+				co_return false;
+			co_await connectionActivity(connection, [&connection]
+				{ return connection.getOutgoingDataSize() == 0 or connectionEnded(connection); });
+		}
+		co_return not connection.isFailed();
+	}
+}
+
+NetTask<std::string> Connection::receiveAtLeast(size_t minSize)
+{
+	return receiveAtLeastTask(*this, minSize);
+}
+
+NetTask<bool> Connection::sendAll(std::string data)
+{
+	return sendAllTask(*this, std::move(data));
+}
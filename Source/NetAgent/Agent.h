@@ -1,37 +1,76 @@
 // Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
 #pragma once
 #include "Sockets/Sockets.h"
+#include "NetThread/SendQueue.h"
+#include "NetThread/DatagramThread.h"
+#include "NetThread/Resolver.h"
+#include "NetAgent/ConnectionPool.h"
+#include "NetThread/Coroutines.h"
+#include "NetThread/SlotMap.h"
 #include <vector>
 #include <memory>
 #include <string>
 #include <string_view>
+#include <functional>
+#include <cstdint>
+#include <atomic>
+#include <optional>
+#include <deque>
+#include <span>
 
 class StreamThread;
 class ListenThread;
+class EventLoopThread;
 
-typedef size_t ConnectionId;
+// key of the connection in its agent's registry, a removed connection's id never refers to a later one
+typedef uint64_t ConnectionId;
 class NetAgentSettings;
 
+// copies are handles to the same connection, the stream stays alive until the last handle is destroyed
+// a copy can be handed to another thread, unlike a reference into Agent::getAllConnections which moves when connections are
+// added or removed, the id stays valid for looking the connection up again
 class Connection
 {
 public:
-	// server
-    Connection(SOCKET connectedSocket, bool useEncryption, const std::shared_ptr<NetAgentSettings>& settings, ConnectionId id);
-	// client
-    Connection(std::string_view hostname, std::string_view port, const std::shared_ptr<NetAgentSettings>& settings, ConnectionId id);
+	// server, if an event loop is provided it services the connection instead of a dedicated thread
+    Connection(SOCKET connectedSocket, bool useEncryption, const std::shared_ptr<NetAgentSettings>& settings, ConnectionId id,
+				EventLoopThread* eventLoop = nullptr);
+	// client, the hostname is resolved through the resolver if provided, if an event loop is provided it services the connection
+	// once connected
+    Connection(std::string_view hostname, std::string_view port, const std::shared_ptr<NetAgentSettings>& settings, ConnectionId id,
+				Resolver* resolver = nullptr, EventLoopThread* eventLoop = nullptr);
 
     bool isConnected() const;
     bool isFailed() const;
+    bool isConnecting() const; // client: not connected yet, and not failed yet
     void Close();
 
     bool send(std::string_view data);
+	// non-blocking, queues as much of the data as fits below the send high watermark, returns the number of bytes queued
+	// the rest is up to the caller to send once the connection is writable again (see NetAgentSettings::sendHighWatermark)
+	size_t trySend(std::string_view data);
+	bool isWritable() const;
+	// threadsafe, called from the thread servicing the connection once it is writable again after trySend queued less than asked
+	// the callback must return quickly and must not call into the connection, nullptr removes it
+	void setWritableCallback(std::function<void()> callback);
+	// sends the segments in order after previously sent data, their storage is referenced until sent instead of being copied
+	bool sendSegments(std::vector<SendSegment> segments);
     void receive(std::string& data);
 	size_t getIncomingDataSize() const;
+	size_t getOutgoingDataSize() const; // sent data not yet handed to the socket
+
+	// awaitables for coroutines run by a CoroutineScheduler, only one operation of a connection may be awaited at a time
+	// completes once at least minSize bytes were received, or with whatever was received once the connection has ended
+	NetTask<std::string> receiveAtLeast(size_t minSize);
+	// completes once the data, and everything sent before it, was handed to the socket, false if the connection ended first
+	NetTask<bool> sendAll(std::string data);
+	// threadsafe, called from the thread servicing the connection on network activity, see StreamThread::setActivityCallback
+	void setActivityCallback(std::function<void()> callback);
 
 	ConnectionId id = 0;
 
 private:
-    std::unique_ptr<StreamThread> thread;
+    std::shared_ptr<StreamThread> thread;
 };
 
 /* CLIENT
@@ -44,35 +83,88 @@ private:
 * 2. Create listen socket, bind socket to own address/port
 * 3. Listen for connections
 * 4. Commence send/receive on connected stream threads */
+
+/* DATAGRAM
+* 1. Bind a UDP socket to own address/port
+* 2. Receive and send datagrams in batches through the datagram thread */
 class Agent
 {
 public:
-    enum class Mode { Server, Client, ServerEncrypted };
+    enum class Mode { Server, Client, ServerEncrypted, Datagram };
     Agent(Mode mode);
     ~Agent();
 
     // establish TCP connection to a remote host, returns a handle to the new connection, client mode only
+	// a "unix:/path" or "unix:@name" hostname connects to a unix domain socket on the same machine instead, the port is ignored
 	Connection& connect(std::string_view hostname, std::string_view port);
 
-    // begin accepting connections, server mode only
+    // begin accepting connections, server mode only, a "unix:" hostname listens on a unix domain socket (see Sockets::ES_UNIX_PREFIX)
     void listen(std::string_view port, std::string_view hostname);
     // stop accepting connections, server mode only
     void stopListening();
+    // awaitable for coroutines run by a CoroutineScheduler, completes with the next new connection, or nothing once not listening
+    // accepting calls updateConnections, which must then not be called from other threads meanwhile, server mode only
+    NetTask<std::optional<Connection>> accept();
 
+    // constant time, the connection must exist
     Connection& getConnection(ConnectionId id);
+    Connection* findConnection(ConnectionId id); // nullptr if the connection has been removed
     size_t numConnections() const;
 	bool updateConnections();
-	std::vector<Connection>& getAllConnections();
+	// blocks until new connections are ready for updateConnections, or the timeout expires, server mode only
+	void waitForConnections(int timeoutMs);
+	// in no particular order, references are invalidated by connecting and by updateConnections
+	std::span<Connection> getAllConnections();
+
+	// hostname resolver with a cache shared by all client connections of the agent, can also be used to resolve names up front
+	Resolver& getResolver();
+
+	// client connections kept open for reuse, acquire a connection to a host from the pool and release it once the exchange is done
+	ConnectionPool& getConnectionPool();
+
+	// which socket options of settings.socketTuning took effect on the listen and accepted sockets, server mode only
+	std::string getSocketTuningReport() const;
+
+	// bind a UDP socket and begin receiving datagrams, port "0" binds any free port (when only sending), datagram mode only
+	bool openDatagram(std::string_view port, std::string_view hostname = "");
+	// calls the handler for each received datagram, up to maxCount received messages, returns the number of datagrams handled
+	size_t receiveDatagrams(const std::function<void(const Datagram&)>& handler, size_t maxCount = SIZE_MAX);
+	// queues a datagram, or with segmentSize a run of datagrams of that size, returns false if the send ring is full
+	bool sendDatagram(const Sockets::SocketAddress& to, std::string_view data, size_t segmentSize = 0);
     
-    bool isServer() const { return listenThread.get(); }
+    bool isServer() const { return mode == Mode::Server or mode == Mode::ServerEncrypted; }
 	void applySettings(const NetAgentSettings& settingsNew);
     
 protected:
-    std::vector<Connection> connections;
-    std::unique_ptr<ListenThread> listenThread;
+    // starts the event loop workers, unless the threading model or the platform makes connections use dedicated threads
+    void startEventLoops();
+    // the worker servicing the fewest connections, new connections are placed on it, nullptr when connections use dedicated threads
+    EventLoopThread* getLeastLoadedEventLoop() const;
+    EventLoopThread* getShardEventLoop(size_t shard) const; // the worker accepting on behalf of a listen shard (completion mode)
+
+    // a fixed pool of event loop workers services the connections, each connection stays on the worker it was placed on
+    std::vector<std::unique_ptr<EventLoopThread>> eventLoops; // must outlive the connections and listen threads they service
+    bool eventLoopsStarted = false;
+    std::unique_ptr<Resolver> resolver = nullptr; // must outlive the connections resolving through it
+    std::unique_ptr<ConnectionPool> connectionPool = nullptr;
+    SlotMap<Connection> connections; // registry keyed by connection id
+    std::vector<std::unique_ptr<ListenThread>> listenThreads;
+    std::deque<Connection> acceptedConnections; // new connections not yet returned by accept
+    std::string connectionLimitResponse{}; // written to connections dropped over connectionsMax, such as an HTTP 503
+    bool acceptQueueEnabled = false; // only collected once accept has been used
+    std::unique_ptr<DatagramThread> datagramThread = nullptr;
 	Mode mode;
 	std::shared_ptr<NetAgentSettings> settings = nullptr;
-	ConnectionId connectionIdCounter = 0;
+	// ids of pooled connections, which may be created from other threads and are not in the registry, registry ids start at 2^32
+	std::atomic<ConnectionId> connectionIdCounter = 0;
+};
+
+// how a server agent services its connections
+enum class NetThreadingModel
+{
+	ThreadPerConnection, // each connection polls its socket from a dedicated stream thread
+	EventLoop, // connections are serviced by a pool of event loop workers, which only wake on socket readiness (Linux only)
+	IoUring // like EventLoop, but accepts, receives and sends complete in batches through io_uring, falls back to EventLoop (Linux only)
 };
 
 // settings for a network agent instance
@@ -82,6 +174,35 @@ public:
 	// server: maximum number of connections that can be active at the same time
 	size_t connectionsMax = 100;
 
+	// how connections are serviced, falls back to ThreadPerConnection where no event loop is supported
+	// client connections still connect on a thread of their own, which exits once the connection is handed to an event loop
+	NetThreadingModel threadingModel = NetThreadingModel::ThreadPerConnection;
+
+	// number of event loop workers servicing the connections of the agent, 0 uses one worker per hardware thread
+	// each new connection is placed on the worker servicing the fewest connections
+	size_t eventLoopWorkers = 0;
+
+	// server: number of listen sockets bound to the same port with SO_REUSEPORT, the kernel spreads new connections between them
+	// each shard accepts on its own thread, 0 uses one shard per hardware thread
+	size_t listenShards = 1;
+
+	// cores the threads servicing connections run on, event loop worker i is pinned to workerCores[i % size], with
+	// ThreadPerConnection each stream thread may run on any of them, empty leaves placement to the OS (Linux only)
+	// a connection's buffers and encryption state are allocated on the memory node of the worker servicing it
+	std::vector<int> workerCores{};
+
+	// server: cores the listen threads run on, shard i is pinned to listenCores[i % size], empty leaves placement to the OS (Linux only)
+	std::vector<int> listenCores{};
+
+	// server: each listen shard takes the connections whose packets the kernel received on the shard's core (SO_INCOMING_CPU),
+	// and hands them to the event loop worker pinned to the same core, so a connection is serviced where its interrupts arrive
+	// needs the receive queue interrupts steered to listenCores (RSS and IRQ affinity), and the same cores in workerCores
+	// kernels before 6.2 ignore the core when choosing between SO_REUSEPORT listen sockets (Linux only)
+	bool steerToIncomingCpu = false;
+
+	// server: maximum number of connections the kernel queues for each listen socket before they are accepted
+	int listenBacklog = 100;
+
 	// maxmimum time to keep a connection open when no communication is happening (seconds)
 	double communicationGapMaxSec = 10.0;
 
@@ -97,9 +218,68 @@ public:
 	// server: slow down the listen thread acceptance check loop by this amount while concurrentConnectRequestsMax is exceeded (milliseconds)
 	double connectRequestOverloadDelayMs = 80.0;
 
+	// outgoing data a connection holds before Connection::trySend stops accepting more, the connection then reports being
+	// writable again once the data drains below sendLowWatermark (bytes)
+	// Connection::send and sendSegments queue everything regardless, memory is only bounded for writers using trySend
+	size_t sendHighWatermark = 4 * 1024 * 1024;
+	size_t sendLowWatermark = 1024 * 1024;
+
+	// received data the application has not taken before a connection stops reading from its socket, the kernel then buffers
+	// further data and shrinks the window the peer may send into, reading resumes once the application has taken enough
+	// that no more than receiveLowWatermark remains, up to ES_SEGMENT_BUFFER_CAPACITY_MAX (bytes)
+	// with NetThreadingModel::IoUring data the kernel received into the loop's buffers before the pause took effect still arrives
+	size_t receiveHighWatermark = 4 * 1024 * 1024;
+	size_t receiveLowWatermark = 1024 * 1024;
+
+	// send large responses with MSG_ZEROCOPY, the kernel transmits directly from the response memory instead of copying it (Linux only)
+	// unencrypted connections only, disabled per connection if the kernel reports that it copied the data anyway (such as over loopback)
+	bool sendZerocopy = false;
+
+	// smallest send that uses MSG_ZEROCOPY, below this the cost of pinning pages and handling the completion exceeds the copy (bytes)
+	size_t sendZerocopyMinSize = 32768;
+
+	// server: once the TLS handshake completes, hand encryption of outgoing records to the kernel (kTLS, Linux only)
+	// encrypted responses are then sent as unencrypted ones are, static files included through sendfile, received data is still
+	// decrypted in user space, connections fall back to user space encryption if the kernel or the cipher suite does not support it
+	// not used with NetThreadingModel::IoUring, where sends may still be in flight when the handshake completes
+	bool kernelTls = false;
+
+	// datagram: number of preallocated message slots in each of the receive and send rings, rounded up to a power of two
+	// when the receive ring is full the kernel socket buffer absorbs further datagrams, and drops them once it is full too
+	size_t datagramRingSlots = 1024;
+
+	// datagram: size of each message slot, the largest datagram or segmented run of datagrams that can be sent or received (bytes)
+	size_t datagramSlotSize = 2048;
+
+	// datagram: let the kernel coalesce received datagrams of one flow into a single message (UDP GRO, Linux only)
+	// receive slots grow to 64 KB each, so fewer datagramRingSlots are needed for the same throughput
+	bool datagramReceiveCoalescing = false;
+
+	// socket options for listen, accepted and client sockets, start from a profile such as
+	// Sockets::SocketTuning::fromProfile(Sockets::SocketProfile::Latency) and adjust individual options as needed
+	// options the platform or kernel rejects are skipped, Agent::getSocketTuningReport tells which ones took effect
+	Sockets::SocketTuning socketTuning{};
+
 	// maximum time a receive operation can wait if data is not available (milliseconds)
 	double socketMaxReceiveWaitMs = 10.0;
 
 	// client: maximum acceptable time for a client connection to be established (seconds)
 	double clientConnectTimeoutSec = 3.0;
+
+	// client: maximum number of pooled connections to each host:port, handed out and idle ones together
+	// idle pooled connections are closed after being unused for most of communicationGapMaxSec
+	size_t poolConnectionsPerHostMax = 8;
+
+	// client: number of threads resolving hostnames, lookups of different hostnames run concurrently
+	size_t resolverThreads = 4;
+
+	// client: how long resolved addresses are reused before the hostname is looked up again, 0 disables caching (seconds)
+	// the system resolver does not report the TTL of the records, so this is used as the TTL of every record
+	double resolverCacheTtlSec = 60.0;
+
+	// client: how long a failed lookup is remembered before the hostname is looked up again (seconds)
+	double resolverNegativeTtlSec = 5.0;
+
+	// client: maximum number of hostnames kept in the resolver cache
+	size_t resolverCacheMax = 1024;
 };
\ No newline at end of file
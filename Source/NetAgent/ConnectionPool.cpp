@@ -0,0 +1,128 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#include "ConnectionPool.h"
+#include "NetAgent/Agent.h"
+#include "NetThread/StreamThread.h"
+#include "NetAgent/HttpServerUtils/Logging.h"
+#include <algorithm>
+
+// the stream closes itself communicationGapMaxSec after its last communication, idle connections are evicted a little earlier
+// so that a connection is not closed right after it was handed out
+constexpr double ES_POOL_IDLE_EVICT_FRACTION = 0.9;
+
+ConnectionPool::ConnectionPool(const std::shared_ptr<NetAgentSettings>& settings_, Connector connector_)
+    : settings{ settings_ ? settings_ : std::make_shared<NetAgentSettings>() }, connector{ std::move(connector_) }
+{}
+
+ConnectionPool::~ConnectionPool() = default;
+
+Connection* ConnectionPool::acquire(std::string_view hostname, std::string_view port)
+{
+    std::string key = std::string(hostname) + ":" + std::string(port);
+    std::vector<std::unique_ptr<Connection>> closed; // destroyed after unlocking, closing joins the stream thread
+    std::lock_guard<std::mutex> lock(mutex);
+    const Clock::time_point now = Clock::now();
+    evictIdle(now, closed);
+
+    std::vector<Entry>& entries = hosts[key];
+    // the most recently released connection is the least likely to have been closed by the peer
+    auto idle = std::max_element(entries.begin(), entries.end(), [](const Entry& a, const Entry& b)
+        { return (a.inUse ? Clock::time_point::min() : a.idleSince) < (b.inUse ? Clock::time_point::min() : b.idleSince); });
+    if (idle != entries.end() and not idle->inUse)
+    {
+        idle->inUse = true;
+        handedOut[idle->connection.get()] = std::move(key);
+        return idle->connection.get();
+    }
+
+    if (entries.size() >= settings->poolConnectionsPerHostMax)
+        return nullptr;
+    std::unique_ptr<Connection> connection = connector(hostname, port);
+    if (not connection)
+        return nullptr;
+    Connection* handle = connection.get();
+    entries.push_back(Entry{ .connection = std::move(connection), .inUse = true });
+    handedOut[handle] = std::move(key);
+    ESLog::es_detail(ESLog::FormatStr() << "Pooled connection " << handle->id << " to " << hostname << ":" << port << " opened, "
+                     << entries.size() << " to this host");
+    return handle;
+}
+
+void ConnectionPool::release(Connection& connection, bool reusable)
+{
+    std::unique_ptr<Connection> closed = nullptr;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto key = handedOut.find(&connection);
+    if (key == handedOut.end())
+        return; // not from this pool, or already released
+    std::vector<Entry>& entries = hosts[key->second];
+    handedOut.erase(key);
+    auto entry = std::find_if(entries.begin(), entries.end(), [&](const Entry& e) { return e.connection.get() == &connection; });
+    if (entry == entries.end())
+        return;
+
+    if (reusable and isHealthy(connection))
+    {
+        entry->inUse = false;
+        entry->idleSince = Clock::now();
+        return;
+    }
+    closed = std::move(entry->connection);
+    closed->Close();
+    entries.erase(entry);
+}
+
+void ConnectionPool::evictIdle()
+{
+    std::vector<std::unique_ptr<Connection>> closed;
+    std::lock_guard<std::mutex> lock(mutex);
+    const Clock::time_point now = Clock::now();
+    evictIdle(now, closed);
+}
+
+void ConnectionPool::evictIdle(Clock::time_point now, std::vector<std::unique_ptr<Connection>>& closed)
+{
+    for (auto host = hosts.begin(); host != hosts.end();)
+    {
+        evictIdle(host->second, now, closed);
+        host = host->second.empty() ? hosts.erase(host) : std::next(host);
+    }
+}
+
+void ConnectionPool::evictIdle(std::vector<Entry>& entries, Clock::time_point now, std::vector<std::unique_ptr<Connection>>& closed)
+{
+    const auto idleMax = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(settings->communicationGapMaxSec * ES_POOL_IDLE_EVICT_FRACTION));
+    std::erase_if(entries, [&](Entry& entry)
+    {
+        if (entry.inUse or (now - entry.idleSince < idleMax and isHealthy(*entry.connection)))
+            return false;
+        ESLog::es_detail(ESLog::FormatStr() << "Pooled connection " << entry.connection->id << " evicted");
+        entry.connection->Close();
+        closed.push_back(std::move(entry.connection));
+        return true;
+    });
+}
+
+bool ConnectionPool::isHealthy(const Connection& connection)
+{
+    // data that arrived while idle would be mistaken for the response to the next request
+    return connection.isConnected() and not connection.isFailed() and connection.getIncomingDataSize() == 0;
+}
+
+size_t ConnectionPool::numConnections() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t count = 0;
+    for (const auto& [key, entries] : hosts)
+        count += entries.size();
+    return count;
+}
+
+size_t ConnectionPool::numIdle() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t count = 0;
+    for (const auto& [key, entries] : hosts)
+        count += std::count_if(entries.begin(), entries.end(), [](const Entry& entry) { return not entry.inUse; });
+    return count;
+}
@@ -0,0 +1,59 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#pragma once
+#include <mutex>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <chrono>
+
+class Connection;
+class NetAgentSettings;
+
+// client connections kept open by host:port, so repeated requests to the same host skip the lookup and the handshake
+// a connection is either handed out to one user at a time, or idle in the pool until it is handed out again or evicted
+class ConnectionPool
+{
+public:
+    using Connector = std::function<std::unique_ptr<Connection>(std::string_view hostname, std::string_view port)>;
+
+    // the connector creates new connections, it is called with the pool locked
+    ConnectionPool(const std::shared_ptr<NetAgentSettings>& settings, Connector connector);
+    ~ConnectionPool();
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+    // threadsafe, hands out an idle connection to the host, or starts a new one while the host is under the connection limit
+    // a new connection may still be connecting, returns nullptr if all of the host's connections are in use
+    Connection* acquire(std::string_view hostname, std::string_view port);
+    // threadsafe, returns a handed out connection to the pool, it is closed instead if not reusable or no longer connected
+    void release(Connection& connection, bool reusable = true);
+    // threadsafe, closes connections that have been idle for too long, also done by acquire
+    void evictIdle();
+
+    size_t numConnections() const; // handed out and idle
+    size_t numIdle() const;
+
+protected:
+    using Clock = std::chrono::steady_clock;
+    struct Entry
+    {
+        std::unique_ptr<Connection> connection;
+        bool inUse = true;
+        Clock::time_point idleSince{};
+    };
+
+    // an idle connection can be handed out if it is still connected and the peer has not sent anything unrequested
+    static bool isHealthy(const Connection& connection);
+    // removes idle connections that expired or failed from the entries, their connections are moved to closed, mutex must be held
+    void evictIdle(Clock::time_point now, std::vector<std::unique_ptr<Connection>>& closed); // all hosts, mutex must be held
+    void evictIdle(std::vector<Entry>& entries, Clock::time_point now, std::vector<std::unique_ptr<Connection>>& closed);
+
+    std::shared_ptr<NetAgentSettings> settings = nullptr;
+    Connector connector;
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, std::vector<Entry>> hosts; // by host:port
+    std::unordered_map<const Connection*, std::string> handedOut; // host:port of each connection in use
+};
@@ -11,8 +11,6 @@
 
 namespace HTTP
 {
-	constexpr auto ES_ENABLE_HTTPSRV_THREADING = false;
-
 	HttpServer::HttpServer(HttpServer::HttpMode httpMode, ServerMode serverMode)
 		: Agent{ (httpMode == HttpServer::HttpMode::HTTP) ? Agent::Mode::Server : Agent::Mode::ServerEncrypted }, 
 		httpMode{ httpMode }, serverMode{ serverMode }
@@ -24,6 +22,12 @@ namespace HTTP
 		handlers.push_back(HttpHandlerBinding{ .method = httpMethod, .execute = handlerFunction });
 	}
 
+	void HttpServer::bindRequestHandler(HttpMethodType httpMethod, std::function<NetTask<HttpResponse>(const HttpRequest&)> handlerFunction)
+	{
+		handlers.push_back(HttpHandlerBinding{ .method = httpMethod, .executeAsync = handlerFunction });
+		hasCoroutineHandlers = true;
+	}
+
 	void HttpServer::bindRequestHandler(std::string_view filesystemWebrootPath)
 	{
 		using namespace std::placeholders;
@@ -41,6 +45,25 @@ namespace HTTP
 	{
 		Agent::applySettings(settingsNew);
 		httpSettings = std::make_shared<HttpServerSettings>(httpSettingsNew);
+		if (httpSettings->requestHandlerThreads > 0 and not requestExecutor)
+			requestExecutor = std::make_unique<WorkStealingExecutor>(httpSettings->requestHandlerThreads);
+		applyLoadShedding();
+	}
+
+	void HttpServer::applyLoadShedding()
+	{
+		concurrencyLimiter.reset();
+		if (httpSettings->adaptiveConcurrencyLimit)
+			concurrencyLimiter = std::make_unique<ConcurrencyLimiter>(httpSettings->concurrencyLimitInitial, 
+				httpSettings->concurrencyLimitMin, httpSettings->concurrencyLimitMax);
+
+		HttpResponse response = HttpResponse::errorResponse(httpSettings->loadShedStatus);
+		if (httpSettings->loadShedRetryAfterSec > 0)
+			response.addHeaderField("Retry-After", std::to_string(httpSettings->loadShedRetryAfterSec));
+		loadShedResponse = std::make_shared<const std::string>(response.finalizeToString());
+		// connections over the limit are closed after the response, plaintext only since there is no TLS session to write it to
+		response.addHeaderField("Connection", "close");
+		connectionLimitResponse = (httpMode == HttpMode::HTTP) ? response.finalizeToString() : std::string{};
 	}
 
 	void HttpServer::start(std::string_view address, std::string_view port)
@@ -52,7 +75,10 @@ namespace HTTP
 #endif
 		const auto listenPort = port.empty() ? ((httpMode == HttpMode::HTTPS) ? "443" : "80") : port;
 		if (not httpSettings.get())
+		{
 			httpSettings = std::make_shared<HttpServerSettings>(HttpServerSettings());
+			applyLoadShedding();
+		}
 		Agent::listen(listenPort, address);
 	}
 
@@ -61,88 +87,243 @@ namespace HTTP
 		Agent::updateConnections();
 		httpFilesystem.refreshTimed(httpSettings->filesystemRefreshIntervalSec);
 
+		HandledRequest handled;
+		while (handledRequests.pop(handled))
+		{
+			completeRequest(handled.connectionId);
+			armKeepAlive(handled.connectionId);
+			logTaskResult(handled.result);
+		}
+		armSentKeepAlives();
+		expireRequestTimers();
+
 		for (Connection& conn : Agent::getAllConnections())
 		{
-			if (conn.getIncomingDataSize() >= 26)
+			if (conn.getIncomingDataSize() == 0 or connectionsInHandling.contains(conn.id))
+				continue;
+			ConnectionDeadline& deadline = connectionDeadlines[conn.id];
+			std::string received;
+			conn.receive(received);
+			deadline.partialRequest += received;
+			const RequestCompleteness completeness = InputHandler::getHttpRequestCompleteness(deadline.partialRequest);
+			if (completeness == RequestCompleteness::PARTIAL)
 			{
-				//ESLog::es_detail(ESLog::FormatStr() << "Incoming " << conn.getIncomingDataSize() << " bytes");
-				if (ES_ENABLE_HTTPSRV_THREADING)
-					futures.push_back(std::async(std::launch::async, &HttpServer::handleHttpRequest, std::ref(conn), std::ref(handlers)));
-				else
-					HttpServer::handleHttpRequest(conn, handlers);
+				if (not deadline.receivingRequest)
+				{
+					deadline.receivingRequest = true;
+					deadline.timer.key = conn.id;
+					requestTimers.arm(deadline.timer, httpSettings->requestReadTimeoutSec * 1000.0);
+				}
+				continue;
+			}
+			std::string requestString = std::move(deadline.partialRequest);
+			connectionDeadlines.erase(conn.id);
+			if (not admitRequest(conn))
+				continue;
 
+			connectionsInHandling[conn.id].start();
+			if (hasCoroutineHandlers)
+			{
+				coroutineScheduler.spawn(serveHttpRequest(conn, std::move(requestString), completeness));
+				continue;
 			}
+			if (not requestExecutor)
+			{
+				HttpServer::handleHttpRequest(conn, requestString, completeness, handlers);
+				completeRequest(conn.id);
+				armKeepAlive(conn.id);
+				continue;
+			}
+			// the task holds its own handle, the connection outlives its removal from the agent until the request is handled
+			requestExecutor->submit([this, handle = conn, requestString = std::move(requestString), completeness]() mutable
+			{
+				const HttpTaskResult result = handleHttpRequest(handle, requestString, completeness, handlers);
+				handledRequests.push(HandledRequest{ .connectionId = handle.id, .result = result });
+			});
 		}
+		if (hasCoroutineHandlers)
+			coroutineScheduler.runFor(0);
+	}
 
-		auto it = futures.begin();
-		while (it != futures.end())
+	bool HttpServer::admitRequest(Connection& connection)
+	{
+		if (not concurrencyLimiter or concurrencyLimiter->tryAcquire())
+			return true;
+		// the request is not parsed, turning it away has to stay cheaper than handling it
+		connection.sendSegments({ SendSegment(loadShedResponse) });
+		armKeepAlive(connection.id);
+		ESLog::es_detail(ESLog::FormatStr() << "Request shed, " << concurrencyLimiter->numInFlight() << " requests in handling at limit "
+						 << concurrencyLimiter->getLimit());
+		return false;
+	}
+
+	void HttpServer::completeRequest(ConnectionId id)
+	{
+		const auto it = connectionsInHandling.find(id);
+		if (it == connectionsInHandling.end())
+			return;
+		if (concurrencyLimiter)
+			concurrencyLimiter->complete(it->second.getElapsedMs());
+		connectionsInHandling.erase(it);
+	}
+
+	void HttpServer::armKeepAlive(ConnectionId id)
+	{
+		if (httpSettings->keepAliveTimeoutSec <= 0.0)
+			return;
+		const Connection* conn = Agent::findConnection(id);
+		if (not conn)
+			return;
+		if (conn->getOutgoingDataSize() > 0)
+		{
+			keepAliveAfterSend.insert(id); // the connection is not idle until the response has left
+			return;
+		}
+		ConnectionDeadline& deadline = connectionDeadlines[id];
+		deadline.timer.key = id;
+		requestTimers.arm(deadline.timer, httpSettings->keepAliveTimeoutSec * 1000.0);
+	}
+
+	void HttpServer::armSentKeepAlives()
+	{
+		std::erase_if(keepAliveAfterSend, [this](ConnectionId id)
 		{
-			std::future<HttpTaskResult>& future = *it;
-			if (future.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+			const Connection* conn = Agent::findConnection(id);
+			if (conn and conn->getOutgoingDataSize() > 0)
+				return false;
+			// a connection that has moved on to its next request is timed by that request instead
+			const auto deadline = connectionDeadlines.find(id);
+			const bool receiving = (deadline != connectionDeadlines.end() and deadline->second.receivingRequest);
+			if (conn and not receiving and not connectionsInHandling.contains(id))
+				armKeepAlive(id);
+			return true;
+		});
+	}
+
+	void HttpServer::expireRequestTimers()
+	{
+		requestTimers.advance([this](WheelTimer& timer)
+		{
+			const auto deadline = connectionDeadlines.find(timer.key);
+			if (Connection* conn = Agent::findConnection(timer.key))
 			{
-				const HttpTaskResult result = future.get();
-				const std::string status = ESLog::FormatStr() << (uint32_t)result.statusCode << " " << httpStatusCodeToString(result.statusCode);
-				ESLog::es_detail(ESLog::FormatStr() << "Processed request in " << result.timeTakenToCompleteMs << "ms" 
-										<< "\n{ \n\t" << result.request.toShortString() << "\n }\n" << status << "\n");
-				it = futures.erase(it);
+				// data queued since the keep-alive was armed, such as a later response, is not cut off
+				if (not deadline->second.receivingRequest and conn->getOutgoingDataSize() > 0)
+				{
+					requestTimers.arm(timer, httpSettings->keepAliveTimeoutSec * 1000.0);
+					return;
+				}
+				if (deadline->second.receivingRequest)
+					ESLog::es_detail(ESLog::FormatStr() << "Connection " << conn->id << " closed: request not completed in time");
+				conn->Close();
 			}
-			else
+			connectionDeadlines.erase(deadline); // destroys the timer, which the wheel no longer references
+		});
+	}
+
+	void HttpServer::logTaskResult(const HttpTaskResult& result)
+	{
+		const std::string status = ESLog::FormatStr() << (uint32_t)result.statusCode << " " << httpStatusCodeToString(result.statusCode);
+		ESLog::es_detail(ESLog::FormatStr() << "Processed request in " << result.timeTakenToCompleteMs << "ms" 
+								<< "\n{ \n\t" << result.request.toShortString() << "\n }\n" << status << "\n");
+	}
+
+	HttpTaskResult HttpServer::handleHttpRequest(Connection& connection, const std::string& requestString, RequestCompleteness completeness,
+												 std::vector<HttpHandlerBinding>& methodHandlers)
+	{
+		WIN_SET_THREAD_NAME(L"HTTP request handler");
+		Timer requestCompletionTimer{};
+		requestCompletionTimer.start();
+
+		HttpRequest request;
+		HttpTaskResult failure;
+		if (not parseReceivedRequest(requestString, completeness, request, failure, requestCompletionTimer))
+			return failure;
+
+		for (HttpHandlerBinding& handler : methodHandlers)
+		{
+			if ((handler.method == request.method or handler.method == HttpMethodType::ANY_M) and handler.execute)
 			{
-				++it;
+				HttpResponse response = handler.execute(request);
+				if (not response.handled)
+					continue; // handler refused to process the request, try other handlers
+				sendResponse(connection, response);
+				return HttpTaskResult{ .statusCode = response.statusCode, .request = request, .timeTakenToCompleteMs = requestCompletionTimer.getElapsedMs() };
 			}
 		}
+
+		return HttpTaskResult{ .statusCode = HttpStatusCode::METHOD_NOT_ALLLOWED, .request = {}, .timeTakenToCompleteMs = requestCompletionTimer.getElapsedMs() };
 	}
 
-	HttpTaskResult HttpServer::handleHttpRequest(Connection& connection, std::vector<HttpHandlerBinding>& methodHandlers)
+	NetTask<void> HttpServer::serveHttpRequest(Connection connection, std::string requestString, RequestCompleteness completeness)
 	{
-		WIN_SET_THREAD_NAME(L"HTTP request handler");
 		Timer requestCompletionTimer{};
 		requestCompletionTimer.start();
-		
-		std::string requestString;
-		RequestCompleteness completeness = RequestCompleteness::PARTIAL;
-		// parse request in pieces, and impose a timeout to mitigate "low and slow" clients
-		while (completeness == RequestCompleteness::PARTIAL and (requestCompletionTimer.getElapsed() < 3.f))
+
+		HttpRequest request;
+		HttpTaskResult result;
+		if (parseReceivedRequest(requestString, completeness, request, result, requestCompletionTimer))
 		{
-			connection.receive(requestString);
-			completeness = InputHandler::getHttpRequestCompleteness(requestString);
+			result = HttpTaskResult{ .statusCode = HttpStatusCode::METHOD_NOT_ALLLOWED, .request = {} };
+			for (HttpHandlerBinding& handler : handlers)
+			{
+				if (handler.method != request.method and handler.method != HttpMethodType::ANY_M)
+					continue;
+				HttpResponse response;
+				if (handler.executeAsync)
+					response = co_await handler.executeAsync(request);
+				else
+					response = handler.execute(request);
+				if (not response.handled)
+					continue; // handler refused to process the request, try other handlers
+				sendResponse(connection, response);
+				result = HttpTaskResult{ .statusCode = response.statusCode, .request = request };
+				break;
+			}
+			result.timeTakenToCompleteMs = requestCompletionTimer.getElapsedMs();
 		}
+		handledRequests.push(HandledRequest{ .connectionId = connection.id, .result = result });
+	}
 
+	bool HttpServer::parseReceivedRequest(const std::string& requestString, RequestCompleteness completeness, HttpRequest& requestOut, 
+										  HttpTaskResult& failureOut, const Timer& requestCompletionTimer)
+	{
 		if (requestString.empty() or completeness == RequestCompleteness::BAD)
-			return HttpTaskResult{ .statusCode = HttpStatusCode::BAD_REQUEST, .request = {}, .timeTakenToCompleteMs = requestCompletionTimer.getElapsedMs() };
+		{
+			failureOut = HttpTaskResult{ .statusCode = HttpStatusCode::BAD_REQUEST, .request = {}, .timeTakenToCompleteMs = requestCompletionTimer.getElapsedMs() };
+			return false;
+		}
 
 		HttpStatusCode parserStatus = HttpStatusCode::SRV_ERROR;
-		HttpRequest request = InputHandler::parseHttpRequestSafe(requestString, parserStatus);
+		requestOut = InputHandler::parseHttpRequestSafe(requestString, parserStatus);
 
 		// return early for issues found during parsing
-		if (httpStatusCodeIsError(parserStatus) or request.method == HttpMethodType::UNRECOGNIZED_M)
+		if (httpStatusCodeIsError(parserStatus) or requestOut.method == HttpMethodType::UNRECOGNIZED_M)
 		{
+			HttpStatusCode status = HttpStatusCode::BAD_REQUEST;
 			if (parserStatus == HttpStatusCode::URI_TOO_LONG or 
 				parserStatus == HttpStatusCode::PAYLOAD_TOO_LARGE or 
 				parserStatus == HttpStatusCode::NO_REQUEST_LENGTH)
-				return HttpTaskResult{ .statusCode = parserStatus, .request = {}, .timeTakenToCompleteMs = requestCompletionTimer.getElapsedMs()};
-			if (request.method == HttpMethodType::UNRECOGNIZED_M)
-				return HttpTaskResult{ .statusCode = HttpStatusCode::METHOD_NOT_ALLLOWED, .request = {}, .timeTakenToCompleteMs = requestCompletionTimer.getElapsedMs() };
-			return HttpTaskResult{ .statusCode = HttpStatusCode::BAD_REQUEST, .request = {}, .timeTakenToCompleteMs = requestCompletionTimer.getElapsedMs() };
-		}
-		
-		for (HttpHandlerBinding& handler : methodHandlers)
-		{
-			if (handler.method == request.method or handler.method == HttpMethodType::ANY_M)
-			{
-				const HttpResponse response = handler.execute(request);
-				if (not response.handled)
-					continue; // handler refused to process the request, try other handlers
-
-				std::string responseString = response.finalizeToString();
-
-				connection.send(responseString);
-
-				return HttpTaskResult{ .statusCode = response.statusCode, .request = request, .timeTakenToCompleteMs = requestCompletionTimer.getElapsedMs() };
-			}
+				status = parserStatus;
+			else if (requestOut.method == HttpMethodType::UNRECOGNIZED_M)
+				status = HttpStatusCode::METHOD_NOT_ALLLOWED;
+			failureOut = HttpTaskResult{ .statusCode = status, .request = {}, .timeTakenToCompleteMs = requestCompletionTimer.getElapsedMs() };
+			return false;
 		}
+		return true;
+	}
 
-		return HttpTaskResult{ .statusCode = HttpStatusCode::METHOD_NOT_ALLLOWED, .request = {}, .timeTakenToCompleteMs = requestCompletionTimer.getElapsedMs() };
+	void HttpServer::sendResponse(Connection& connection, HttpResponse& response)
+	{
+		// the header and payload are sent as separate segments, so the payload is never copied into a combined string
+		std::vector<SendSegment> segments{ SendSegment::fromString(response.finalizeHeader()) };
+		if (response.fileBody)
+			segments.push_back(SendSegment::fromFile(response.fileBody));
+		else if (response.sharedPayload)
+			segments.push_back(SendSegment(response.sharedPayload));
+		else if (not response.payload.empty())
+			segments.push_back(SendSegment::fromString(std::move(response.payload)));
+		connection.sendSegments(std::move(segments));
 	}
 
 	
@@ -169,12 +350,13 @@ namespace HTTP
 			return HttpResponse::errorResponse(HttpStatusCode::NOT_FOUND);
 
 		auto fileInfo = httpFilesystem.getFileInfo(fileId);
-		std::string content;
-		if (not httpFilesystem.getFileAsString(fileId, content))
+		auto file = httpFilesystem.openFile(fileId);
+		if (not file)
 			return HttpResponse::errorResponse(HttpStatusCode::SRV_ERROR);
-		if (content.empty())
+		if (file->getSize() == 0)
 			return HttpResponse::errorResponse(HttpStatusCode::NO_CONTENT);
 
+		// the file is not read here, the stream sends it directly from the page cache when possible
 		return HttpResponse
 		{
 			.statusCode = HttpStatusCode::OK,
@@ -183,7 +365,7 @@ namespace HTTP
 					httpFilesystem.makeContentTypeHeaderField(fileInfo.knownExtension)
 				},
 			//{ "Content-Type: text/html; charset=utf-8" }, // TODO: determine content type
-			.payload = content
+			.fileBody = file
 		};
 	}
 
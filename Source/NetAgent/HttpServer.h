@@ -2,19 +2,26 @@
 #pragma once
 #include "NetAgent/Agent.h"
 #include "NetAgent/HttpServerUtils/HttpUtil.h"
+#include "NetAgent/HttpServerUtils/ConcurrencyLimiter.h"
+#include "NetThread/WorkStealingExecutor.h"
+#include "NetThread/MpscQueue.h"
+#include "NetThread/TimerWheel.h"
 
 #include <string>
 #include <string_view>
 #include <vector>
-#include <list>
 #include <filesystem>
-#include <future>
+#include <unordered_set>
+#include <unordered_map>
 
 
 namespace HTTP
 {
 	class HttpServerSettings;
 
+	// resolution of request read and keep-alive timeouts (milliseconds)
+	constexpr uint32_t ES_HTTP_TIMER_TICK_MS = 50;
+
 	// HTTP server agent
 	class HttpServer : public Agent
 	{
@@ -24,19 +31,60 @@ namespace HTTP
 		HttpServer(HttpMode httpMode, ServerMode serverMode);
 
 		void bindRequestHandler(HttpMethodType httpMethod, std::function<HttpResponse(const HttpRequest&)> handlerFunction);
+		// coroutine handler, it may await network operations, such as a request to another server, without blocking other requests
+		// once one is bound every request is served by a coroutine on the thread calling handleRequests, instead of the handler threads
+		void bindRequestHandler(HttpMethodType httpMethod, std::function<NetTask<HttpResponse>(const HttpRequest&)> handlerFunction);
 		void bindRequestHandler(std::string_view filesystemWebrootPath);
 		void applySettings(const NetAgentSettings& settingsNew, const HttpServerSettings& httpSettingsNew);
 		void start(std::string_view address, std::string_view port = "");
+		// accepts connections and dispatches the requests received on them, handlers run on the request handler threads if enabled
+		// a connection has at most one request in handling, the next request on it is dispatched once the response has been queued
 		void handleRequests();
 
 	protected:
 		HttpMode httpMode;
 		ServerMode serverMode;
-		std::vector<HttpHandlerBinding> handlers;
-		std::list<std::future<HttpTaskResult>> futures;
+		std::vector<HttpHandlerBinding> handlers; // must not be modified once requests are handled on the handler threads
 		HttpFilesystem httpFilesystem{};
 		std::shared_ptr<HttpServerSettings> httpSettings = nullptr;
-		static HttpTaskResult handleHttpRequest(Connection& connection, std::vector<HttpHandlerBinding>& methodHandlers);
+		static HttpTaskResult handleHttpRequest(Connection& connection, const std::string& requestString, RequestCompleteness completeness,
+												std::vector<HttpHandlerBinding>& methodHandlers);
+		// coroutine counterpart of handleHttpRequest
+		NetTask<void> serveHttpRequest(Connection connection, std::string requestString, RequestCompleteness completeness);
+		// returns false, and the result to report, if the received request cannot be handled
+		static bool parseReceivedRequest(const std::string& requestString, RequestCompleteness completeness, HttpRequest& requestOut, 
+										 HttpTaskResult& failureOut, const Timer& requestTimer);
+		static void sendResponse(Connection& connection, HttpResponse& response);
+		static void logTaskResult(const HttpTaskResult& result);
+
+		struct HandledRequest { ConnectionId connectionId = 0; HttpTaskResult result{}; };
+		// dispatched to the handler threads, and not completed yet, timed from when the request was dispatched
+		std::unordered_map<ConnectionId, Timer> connectionsInHandling;
+		MpscQueue<HandledRequest> handledRequests; // completed by the handler threads, drained by handleRequests
+		bool hasCoroutineHandlers = false;
+
+		// requests are received by handleRequests, and dispatched once complete, so no handler waits for a slow client
+		// the deadline is the request read timeout while a request is being received, and the keep-alive timeout after a response
+		struct ConnectionDeadline { std::string partialRequest{}; WheelTimer timer{}; bool receivingRequest = false; };
+		std::unordered_map<ConnectionId, ConnectionDeadline> connectionDeadlines;
+		TimerWheel requestTimers{ ES_HTTP_TIMER_TICK_MS };
+		// responses still being sent, the keep-alive timeout starts once the connection has sent everything
+		std::unordered_set<ConnectionId> keepAliveAfterSend;
+		void armKeepAlive(ConnectionId id);
+		void armSentKeepAlives();
+		void expireRequestTimers();
+
+		// load shedding, the responses are built once when the settings are applied so turning a request away stays cheap
+		std::unique_ptr<ConcurrencyLimiter> concurrencyLimiter = nullptr;
+		std::shared_ptr<const std::string> loadShedResponse = nullptr;
+		// returns false after answering the request with the load shed response, if the server is saturated
+		bool admitRequest(Connection& connection);
+		// ends the timing of a dispatched request, feeding its latency to the limiter
+		void completeRequest(ConnectionId id);
+		void applyLoadShedding();
+
+		CoroutineScheduler coroutineScheduler; // runs the requests served by coroutines, driven by handleRequests
+		std::unique_ptr<WorkStealingExecutor> requestExecutor = nullptr; // declared last, so it finishes its requests first
 		
 		HttpResponse filesystemRequestHandler(const HttpRequest& request) const;
 		HttpResponse dynamicRequestHandler(const HttpRequest& request) const;
@@ -18,6 +18,7 @@
 */
 
 #include "TLSInterface.h"
+#include "NetThread/BufferPool.h"
 
 #include <algorithm>
 #include <stdio.h>
@@ -60,8 +61,9 @@ namespace Encryption
 		// unique_ptr is used for these resources so they stay put if the container moves
 		std::unique_ptr<BearSSL::br_ssl_server_context> serverContext = nullptr;
 		std::unique_ptr<BearSSL::br_sslio_context> ioContext = nullptr;
-		std::unique_ptr<uint8_t[]> inputBuffer = nullptr;
-		std::unique_ptr<uint8_t[]> outputBuffer = nullptr;
+		// the io buffers come from the pool, a TLS connection is opened and closed without touching the global allocator for them
+		BufferPool::Buffer inputBuffer = nullptr;
+		BufferPool::Buffer outputBuffer = nullptr;
 		size_t inputBufferSize, outputBufferSize;
 
 		BearSSLResources(size_t inputMaxSize, size_t outputMaxSize);
@@ -70,8 +72,8 @@ namespace Encryption
 		BearSSL::br_ssl_server_context* getServerContext() const { return serverContext.get(); }
 		BearSSL::br_ssl_engine_context* getEngineContext() const { return &getServerContext()->eng; }
 		BearSSL::br_sslio_context* getIoContext() const { return ioContext.get(); }
-		uint8_t* getInputBuffer() const { return inputBuffer.get(); }
-		uint8_t* getOutputBuffer() const { return outputBuffer.get(); }
+		uint8_t* getInputBuffer() const { return reinterpret_cast<uint8_t*>(inputBuffer.get()); }
+		uint8_t* getOutputBuffer() const { return reinterpret_cast<uint8_t*>(outputBuffer.get()); }
 	};
 
 	BearSSLResources::BearSSLResources(size_t inputMaxSize, size_t outputMaxSize)
@@ -86,8 +88,8 @@ namespace Encryption
 	void BearSSLResources::initIo()
 	{
 		// initialize io buffers
-		inputBuffer = std::unique_ptr<uint8_t[]>(new uint8_t[inputBufferSize]);
-		outputBuffer = std::unique_ptr<uint8_t[]>(new uint8_t[outputBufferSize]);
+		inputBuffer = BufferPool::makeBuffer(inputBufferSize);
+		outputBuffer = BufferPool::makeBuffer(outputBufferSize);
 		BearSSL::br_ssl_engine_set_buffers_bidi(getEngineContext(), getInputBuffer(), inputBufferSize, getOutputBuffer(), outputBufferSize);
 	}
 
@@ -226,6 +228,88 @@ namespace Encryption
 		return size;
 	}
 
+	bool TLSContext::isHandshakeComplete()
+	{
+		return (getState() & BR_SSL_SENDAPP);
+	}
+
+	bool TLSContext::hasEncryptedOutgoing()
+	{
+		return (getState() & BR_SSL_SENDREC);
+	}
+
+	TrafficKeys::~TrafficKeys()
+	{
+		volatile unsigned char* wipe = key;
+		for (size_t i = 0; i < sizeof(key); i++)
+			wipe[i] = 0;
+	}
+
+	bool TLSContext::exportOutgoingKeys(TrafficKeys& keysOut)
+	{
+		using namespace BearSSL;
+		br_ssl_engine_context* engine = getResources().getEngineContext();
+		if (not isHandshakeComplete() or hasEncryptedOutgoing() or br_ssl_engine_get_version(engine) != BR_TLS12)
+			return false;
+
+		bool sha384 = false;
+		switch (engine->session.cipher_suite)
+		{
+		case BR_TLS_RSA_WITH_AES_128_GCM_SHA256:
+		case BR_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256:
+		case BR_TLS_ECDH_ECDSA_WITH_AES_128_GCM_SHA256:
+		case BR_TLS_ECDHE_RSA_WITH_AES_128_GCM_SHA256:
+		case BR_TLS_ECDH_RSA_WITH_AES_128_GCM_SHA256:
+			keysOut.cipher = TrafficCipher::AES_128_GCM;
+			keysOut.keySize = 16;
+			keysOut.ivSize = 4;
+			break;
+		case BR_TLS_RSA_WITH_AES_256_GCM_SHA384:
+		case BR_TLS_ECDHE_ECDSA_WITH_AES_256_GCM_SHA384:
+		case BR_TLS_ECDH_ECDSA_WITH_AES_256_GCM_SHA384:
+		case BR_TLS_ECDHE_RSA_WITH_AES_256_GCM_SHA384:
+		case BR_TLS_ECDH_RSA_WITH_AES_256_GCM_SHA384:
+			keysOut.cipher = TrafficCipher::AES_256_GCM;
+			keysOut.keySize = 32;
+			keysOut.ivSize = 4;
+			sha384 = true;
+			break;
+		case BR_TLS_ECDHE_RSA_WITH_CHACHA20_POLY1305_SHA256:
+		case BR_TLS_ECDHE_ECDSA_WITH_CHACHA20_POLY1305_SHA256:
+			keysOut.cipher = TrafficCipher::CHACHA20_POLY1305;
+			keysOut.keySize = 32;
+			keysOut.ivSize = 12;
+			break;
+		default:
+			return false; // CBC and CCM suites are not exported
+		}
+
+		// the record layer in use must match the suite, its sequence number is where the other implementation continues
+		const void* recordLayer = engine->out.vtable;
+		if (keysOut.cipher == TrafficCipher::CHACHA20_POLY1305 and recordLayer == &br_sslrec_out_chapol_vtable)
+			keysOut.sequence = engine->out.chapol.seq;
+		else if (keysOut.cipher != TrafficCipher::CHACHA20_POLY1305 and recordLayer == &br_sslrec_out_gcm_vtable)
+			keysOut.sequence = engine->out.gcm.seq;
+		else
+			return false;
+
+		// key block (RFC 5246 section 6.3): client write key, server write key, client write IV, server write IV
+		unsigned char keyBlock[2 * sizeof(keysOut.key) + 2 * sizeof(keysOut.iv)];
+		const size_t keyBlockSize = 2 * keysOut.keySize + 2 * keysOut.ivSize;
+		const br_tls_prf_seed_chunk seed[2] = { { engine->server_random, sizeof(engine->server_random) },
+												{ engine->client_random, sizeof(engine->client_random) } };
+		(sha384 ? br_tls12_sha384_prf : br_tls12_sha256_prf)(keyBlock, keyBlockSize, engine->session.master_secret,
+															  sizeof(engine->session.master_secret), "key expansion", 2, seed);
+		memcpy(keysOut.key, keyBlock + keysOut.keySize, keysOut.keySize);
+		memcpy(keysOut.iv, keyBlock + 2 * keysOut.keySize + keysOut.ivSize, keysOut.ivSize);
+		volatile unsigned char* wipe = keyBlock;
+		for (size_t i = 0; i < sizeof(keyBlock); i++)
+			wipe[i] = 0;
+
+		br_ssl_engine_add_flags(engine, BR_OPT_NO_RENEGOTIATION);
+		return true;
+	}
+
 	void TLSContext::initCipherSuites(TLSKeyType keyType, CipherSuiteMode mode)
 	{
 		/*
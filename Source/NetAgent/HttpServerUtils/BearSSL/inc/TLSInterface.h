@@ -22,6 +22,8 @@
 #include <memory>
 #include <string>
 #include <string_view>
+#include <cstdint>
+#include <cstddef>
 
 namespace Encryption
 {
@@ -44,6 +46,26 @@ namespace Encryption
 		FULL
 	};
 
+	enum class TrafficCipher
+	{
+		NONE, // the negotiated cipher suite cannot be exported
+		AES_128_GCM,
+		AES_256_GCM,
+		CHACHA20_POLY1305
+	};
+
+	// keys of one direction of a TLS 1.2 session, to hand record encryption over to another implementation (such as kernel TLS)
+	struct TrafficKeys
+	{
+		TrafficCipher cipher = TrafficCipher::NONE;
+		unsigned char key[32]{};
+		size_t keySize = 0;
+		unsigned char iv[12]{}; // implicit part of the record nonce, 4 bytes (salt) for GCM, 12 bytes for ChaCha20-Poly1305
+		size_t ivSize = 0;
+		uint64_t sequence = 0; // sequence number of the next record
+		~TrafficKeys(); // wipes the keys
+	};
+
 	struct BearSSLResources;
 
 	// contains all the context BearSSL needs for a specific TLS connection (server)
@@ -77,6 +99,14 @@ namespace Encryption
 		size_t getPushMaxSizeOutgoing();
 		size_t getSizeDecryptedIncoming();
 
+		// returns true once the handshake has completed and application data can be sent
+		bool isHandshakeComplete();
+		// returns true if encrypted data is waiting to be taken through getEncryptedOutgoing()
+		bool hasEncryptedOutgoing();
+		// exports the keys the server encrypts with, only once all encrypted data has been taken, and only for AEAD cipher suites
+		// after a successful export no more data may be pushed through pushOutgoing(), renegotiation is disabled as it would change the keys
+		bool exportOutgoingKeys(TrafficKeys& keysOut);
+
 	private:
 		// the BearSSL library C types are encapsulated to keep them in the translation unit
 		std::unique_ptr<BearSSLResources> resources = nullptr;
@@ -0,0 +1,53 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#include "NetAgent/HttpServerUtils/ConcurrencyLimiter.h"
+#include <algorithm>
+#include <cmath>
+
+namespace HTTP
+{
+	// weight of each sample in the short and long term latencies, the long term one spans several hundred requests
+	constexpr double ES_LIMITER_SHORT_WEIGHT = 0.1;
+	constexpr double ES_LIMITER_LONG_WEIGHT = 1.0 / 500.0;
+	// latency may rise this much above the long term average before the limit shrinks, absorbs ordinary jitter
+	constexpr double ES_LIMITER_TOLERANCE = 1.5;
+	// fraction of each new limit taken into the limit, keeps one slow request from halving it
+	constexpr double ES_LIMITER_SMOOTHING = 0.2;
+
+	ConcurrencyLimiter::ConcurrencyLimiter(size_t initialLimit, size_t minLimit, size_t maxLimit)
+		: minLimit{ (double)std::max(minLimit, (size_t)1) }, maxLimit{ (double)std::max(maxLimit, std::max(minLimit, (size_t)1)) }
+	{
+		limit = std::clamp((double)initialLimit, this->minLimit, this->maxLimit);
+	}
+
+	bool ConcurrencyLimiter::tryAcquire()
+	{
+		if (inFlight >= (size_t)limit)
+			return false;
+		inFlight++;
+		return true;
+	}
+
+	void ConcurrencyLimiter::complete(double latencyMs)
+	{
+		const size_t concurrency = inFlight; // including this request
+		inFlight = (inFlight > 0) ? inFlight - 1 : 0;
+		latencyMs = std::max(latencyMs, 0.001);
+		if (longLatencyMs == 0.0)
+			shortLatencyMs = longLatencyMs = latencyMs;
+		shortLatencyMs += (latencyMs - shortLatencyMs) * ES_LIMITER_SHORT_WEIGHT;
+		longLatencyMs += (latencyMs - longLatencyMs) * ES_LIMITER_LONG_WEIGHT;
+
+		// once load drops after an overload the long term average is stale, it recovers faster than it would by averaging
+		if (longLatencyMs > 2.0 * shortLatencyMs)
+			longLatencyMs *= 0.95;
+
+		// a server using little of its limit tells nothing about whether more would be too much, the limit only moves when used
+		if (concurrency * 2 < (size_t)limit)
+			return;
+
+		const double gradient = std::clamp(ES_LIMITER_TOLERANCE * longLatencyMs / shortLatencyMs, 0.5, 1.0);
+		const double headroom = std::sqrt(limit); // lets the limit grow while latency holds, and probe for more capacity
+		const double newLimit = limit * gradient + headroom;
+		limit = std::clamp(limit * (1.0 - ES_LIMITER_SMOOTHING) + newLimit * ES_LIMITER_SMOOTHING, minLimit, maxLimit);
+	}
+}
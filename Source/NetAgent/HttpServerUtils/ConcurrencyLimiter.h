@@ -0,0 +1,31 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#pragma once
+#include <cstddef>
+
+namespace HTTP
+{
+	// adaptive limit on the number of requests in handling at once, found from the latency of the requests instead of configured
+	// latency close to the long-term average means the handlers keep up and the limit grows, while latency rising above it means
+	// requests are queueing somewhere (handler threads, a database, the CPU) and the limit shrinks in proportion (gradient method)
+	// requests over the limit are turned away at once, so the admitted ones keep the latency of an unloaded server, not threadsafe
+	class ConcurrencyLimiter
+	{
+	public:
+		ConcurrencyLimiter(size_t initialLimit, size_t minLimit, size_t maxLimit);
+
+		// admits a request if fewer than the limit are in handling, an admitted request must be completed
+		bool tryAcquire();
+		// one of the admitted requests completed, latencyMs after it was admitted (milliseconds)
+		void complete(double latencyMs);
+
+		size_t getLimit() const { return (size_t)limit; }
+		size_t numInFlight() const { return inFlight; }
+
+	private:
+		double limit;
+		const double minLimit, maxLimit;
+		size_t inFlight = 0;
+		double shortLatencyMs = 0.0; // follows the latest requests
+		double longLatencyMs = 0.0; // follows the latency of many requests, the baseline the latest ones are compared to
+	};
+}
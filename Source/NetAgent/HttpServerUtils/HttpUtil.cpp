@@ -6,6 +6,7 @@
 #include <stdint.h>
 #include <fstream>
 #include <algorithm>
+#include <iterator>
 
 
 namespace HTTP
@@ -95,17 +96,43 @@ namespace HTTP
 		headerFields.push_back(ESLog::FormatStr() << name << ((name.ends_with(':')) ? "" : ":") << value);
 	}
 
-	std::string HttpResponse::finalizeToString() const
+	size_t HttpResponse::getPayloadSize() const
+	{
+		if (fileBody)
+			return fileBody->getSize();
+		return sharedPayload ? sharedPayload->size() : payload.size();
+	}
+
+	std::string HttpResponse::finalizeHeader() const
 	{
-		HttpResponse res = *this;
-		res.headerFields.push_back(ESLog::FormatStr() << "Content-Length: " << res.payload.size());
+		const std::string statusLine = makeResponseVersionString() + " " + makeResponseStatusCodeString(statusCode) + "\r\n";
+		const std::string contentLength = "Content-Length: " + std::to_string(getPayloadSize()) + "\r\n";
+		size_t headerSize = statusLine.size() + contentLength.size() + 2;
+		for (const auto& field : headerFields)
+			headerSize += field.size() + 2;
 
 		std::string header{};
-		for (auto& field : res.headerFields)
-			header.append(ESLog::FormatStr() << field << "\r\n");
+		header.reserve(headerSize);
+		header.append(statusLine);
+		for (const auto& field : headerFields)
+			header.append(field).append("\r\n");
+		header.append(contentLength).append("\r\n");
+		return header;
+	}
 
-		return ESLog::FormatStr() << makeResponseVersionString() << " " << makeResponseStatusCodeString(res.statusCode)
-					<< "\r\n" << header << "\r\n" << res.payload;
+	std::string HttpResponse::finalizeToString() const
+	{
+		std::string response = finalizeHeader();
+		if (fileBody)
+		{
+			const size_t headerSize = response.size();
+			response.resize(headerSize + fileBody->getSize());
+			const size_t sizeRead = fileBody->read(0, response.data() + headerSize, fileBody->getSize());
+			response.resize(headerSize + sizeRead);
+			return response;
+		}
+		response.append(sharedPayload ? *sharedPayload : payload);
+		return response;
 	}
 
 	HttpResponse HttpResponse::errorResponse(HttpStatusCode code)
@@ -155,7 +182,9 @@ namespace HTTP
 		if (webroot.empty())
 			return;
 		
-		updateContentTypeMappings();
+		if (fileExtensionContentTypeMappings.empty())
+			updateContentTypeMappings(); // never changes afterwards, so lookups read it without locking
+		std::vector<PathInfo> found; // the tree is walked without blocking lookups
 		for (const auto& p : std::filesystem::recursive_directory_iterator(webroot))
 		{
 			if (not std::filesystem::is_directory(p))
@@ -164,16 +193,20 @@ namespace HTTP
 				const auto rel = std::filesystem::relative(full, webroot);
 				if (full.is_relative() or (not full.is_absolute()) or rel.is_absolute() or (not rel.is_relative()))
 					continue;
-				allowedFilepaths.push_back(PathInfo
+				found.push_back(PathInfo
 					{
 						.relative = std::filesystem::relative(p.path(), webroot),
 						.full = std::filesystem::weakly_canonical(webroot / p.path()),
 						.knownExtension = p.path().extension().string()
 					});
 				if (not filesystemRefreshTimer)
-					ESLog::es_detail(ESLog::FormatStr() << allowedFilepaths.back().relative << " (" << makeContentTypeHeaderField(allowedFilepaths.back().knownExtension) << ")");
+					ESLog::es_detail(ESLog::FormatStr() << found.back().relative << " (" << makeContentTypeHeaderField(found.back().knownExtension) << ")");
 			}
 		}
+		{
+			std::unique_lock<std::shared_mutex> lock(filepathsMutex);
+			allowedFilepaths.insert(allowedFilepaths.end(), std::make_move_iterator(found.begin()), std::make_move_iterator(found.end()));
+		}
 		ESLog::es_info("Refreshed filesystem paths under WebRoot");
 
 		if (filesystemRefreshTimer)
@@ -218,6 +251,7 @@ namespace HTTP
 
 	size_t HttpFilesystem::findFile(const std::filesystem::path& path) const
 	{
+		std::shared_lock<std::shared_mutex> lock(filepathsMutex);
 		for (size_t i = 0; i < allowedFilepaths.size(); i++)
 		{
 			const auto& relative = allowedFilepaths[i].relative;
@@ -236,12 +270,14 @@ namespace HTTP
 
 	bool HttpFilesystem::getFileAsString(size_t id, std::string& contentOut) const
 	{
+		std::shared_lock<std::shared_mutex> lock(filepathsMutex);
 		if (id < 1 or id > allowedFilepaths.size())
 		{
 			ESLog::es_error("Attempted to read file with bad id");
 			return false;
 		}
-		const auto& fullPath = getFileInfo(id).full;
+		const auto fullPath = allowedFilepaths[id - 1].full;
+		lock.unlock();
 
 		if (not (fullPath.is_absolute() and std::filesystem::is_regular_file(fullPath)))
 			return false;
@@ -250,8 +286,26 @@ namespace HTTP
 		return true;
 	}
 
+	std::shared_ptr<const SendFile> HttpFilesystem::openFile(size_t id) const
+	{
+		std::shared_lock<std::shared_mutex> lock(filepathsMutex);
+		if (id < 1 or id > allowedFilepaths.size())
+		{
+			ESLog::es_error("Attempted to open file with bad id");
+			return nullptr;
+		}
+		const auto fullPath = allowedFilepaths[id - 1].full;
+		lock.unlock();
+
+		if (not (fullPath.is_absolute() and std::filesystem::is_regular_file(fullPath)))
+			return nullptr;
+
+		return SendFile::open(fullPath);
+	}
+
 	HttpFilesystem::PathInfo HttpFilesystem::getFileInfo(size_t id) const
 	{
+		std::shared_lock<std::shared_mutex> lock(filepathsMutex);
 		return allowedFilepaths[id - 1];
 	}
 
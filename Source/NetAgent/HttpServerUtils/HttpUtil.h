@@ -2,6 +2,7 @@
 #pragma once
 
 #include "NetThread/NetThreadSync.h"
+#include "NetThread/Coroutines.h"
 #include <stdint.h>
 #include <string>
 #include <string_view>
@@ -11,9 +12,13 @@
 #include <utility>
 #include <functional>
 #include <filesystem>
+#include <memory>
+#include <shared_mutex>
 
 #include <sstream>
 
+class SendFile;
+
 namespace HTTP
 {
 	enum class HttpStatusCode : uint32_t
@@ -101,6 +106,7 @@ namespace HTTP
 	void replaceSubstring(std::string& string, const std::string& from, const std::string& to);
 
 	// NOTE: this could be accelerated with a tree structure
+	// lookups are threadsafe, and may run while the thread calling refreshTimed refreshes the paths, ids stay valid across refreshes
 	class HttpFilesystem
 	{
 	public:
@@ -110,6 +116,7 @@ namespace HTTP
 		struct PathInfo { std::filesystem::path relative, full; std::string knownExtension; };
 		size_t findFile(const std::filesystem::path& path) const; // paths may be matched without file extension
 		bool getFileAsString(size_t id, std::string& contentOut) const;
+		std::shared_ptr<const SendFile> openFile(size_t id) const; // nullptr on failure
 		PathInfo getFileInfo(size_t id) const;
 		FileFormatInfo fileFormatFromExtension(std::string fileExtension) const;
 		FileFormatInfo fileFormatFromPath(std::string path) const;
@@ -118,6 +125,7 @@ namespace HTTP
 	protected:
 		std::filesystem::path webroot{};
 		std::vector<PathInfo> allowedFilepaths{};
+		mutable std::shared_mutex filepathsMutex; // refreshes only append, so an id found before a refresh still names the same file
 
 		std::vector<FileFormatInfo> fileExtensionContentTypeMappings;
 		void updateContentTypeMappings();
@@ -146,7 +154,14 @@ namespace HTTP
 		std::vector<std::string> headerFields{};
 		std::string payload{};
 		bool handled = true;
+		// optional payload shared with other responses (such as cached content), sent without copying, replaces payload when set
+		std::shared_ptr<const std::string> sharedPayload = nullptr;
+		// optional file sent as the payload, plaintext streams send it straight from the page cache, replaces payload when set
+		std::shared_ptr<const SendFile> fileBody = nullptr;
 		void addHeaderField(std::string_view name, std::string_view value);
+		size_t getPayloadSize() const;
+		// status line and header fields including Content-Length, terminated by an empty line
+		std::string finalizeHeader() const;
 		std::string finalizeToString() const;
 		static HttpResponse errorResponse(HttpStatusCode code);
 		static HttpResponse unhandledResponse();
@@ -163,6 +178,7 @@ namespace HTTP
 	{
 		HttpMethodType method = HttpMethodType::UNRECOGNIZED_M;
 		std::function<HttpResponse(const HttpRequest&)> execute{};
+		std::function<NetTask<HttpResponse>(const HttpRequest&)> executeAsync{}; // coroutine handler, set instead of execute
 	};
 
 	enum class RequestCompleteness { PARTIAL, FULL, BAD };
@@ -179,6 +195,33 @@ namespace HTTP
 	{
 		// how long it takes for the file tree to be updated, affects how fast added or renamed files are registered
 		double filesystemRefreshIntervalSec = 30.0;
+
+		// number of threads running request handlers, handlers of different connections then run concurrently and must be threadsafe
+		// 0 runs the handlers on the thread calling handleRequests, one at a time
+		size_t requestHandlerThreads = 0;
+
+		// time a client has to complete a request once it has started sending it, the connection is closed if it does not (seconds)
+		double requestReadTimeoutSec = 3.0;
+
+		// connections with no request in progress are closed once idle for this long after a response, 0 leaves idle connections
+		// open until the communication timeout of the agent settings (seconds)
+		double keepAliveTimeoutSec = 5.0;
+
+		// limits the requests in handling at once to what the handlers keep up with, judged from the latency of the requests
+		// requests over the limit are answered with loadShedStatus before being parsed, instead of queueing behind the others
+		bool adaptiveConcurrencyLimit = false;
+
+		// where the adaptive limit starts, and how far it may move
+		size_t concurrencyLimitInitial = 32;
+		size_t concurrencyLimitMin = 4;
+		size_t concurrencyLimitMax = 1000;
+
+		// status of requests turned away by the concurrency limit, and of connections over NetAgentSettings::connectionsMax
+		// SRV_TEMPORARILY_UNAVAILABLE (503), or TOO_MANY_REQUESTS (429) which clients are expected to back off from
+		HttpStatusCode loadShedStatus = HttpStatusCode::SRV_TEMPORARILY_UNAVAILABLE;
+
+		// Retry-After sent with turned away requests and connections (seconds)
+		int loadShedRetryAfterSec = 1;
 	};
 
 }
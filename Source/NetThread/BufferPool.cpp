@@ -0,0 +1,249 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#include "BufferPool.h"
+#include "ThreadPlacement.h"
+#include <array>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <bit>
+#include <new>
+#include <cstring>
+
+namespace BufferPool
+{
+    namespace
+    {
+        constexpr size_t ES_POOL_CLASSES = 25; // 64 bytes to 256 KiB, two classes per power of two
+        constexpr size_t ES_POOL_SLAB_SIZE = 1024 * 1024;
+        constexpr size_t ES_POOL_CACHE_BYTES = 512 * 1024; // most a thread keeps of one class before returning blocks
+        constexpr size_t ES_POOL_SLAB_HEADER_SIZE = 64; // keeps the blocks after it as aligned as the slab start was
+        constexpr size_t ES_POOL_NODE_SLOTS = 9; // no preferred node, then nodes 0 to 7, higher nodes share slots with these
+
+        // slabs are aligned to their size, so the header of a block's slab is found by masking the block's address
+        struct SlabHeader
+        {
+            size_t nodeSlot;
+        };
+        static_assert(sizeof(SlabHeader) <= ES_POOL_SLAB_HEADER_SIZE);
+
+        // blocks are kept apart per NUMA node, allocations take those of the node preferred for the calling thread
+        size_t preferredNodeSlot()
+        {
+            const int node = ThreadPlacement::preferredNumaNode();
+            return (node < 0) ? 0 : 1 + (size_t)node % (ES_POOL_NODE_SLOTS - 1);
+        }
+        size_t nodeSlotOfBlock(const char* block)
+        {
+            return reinterpret_cast<const SlabHeader*>((uintptr_t)block & ~(uintptr_t)(ES_POOL_SLAB_SIZE - 1))->nodeSlot;
+        }
+
+        size_t classIndex(size_t size)
+        {
+            const size_t rounded = std::max(size, ES_POOL_SIZE_MIN);
+            const unsigned bits = (unsigned)std::bit_width(rounded - 1); // rounded up to a power of two
+            const size_t index = (bits - (unsigned)std::bit_width(ES_POOL_SIZE_MIN - 1)) * 2;
+            // the class three quarters of the way to the power of two, the one below it being a power of two as well
+            return (index > 0 and rounded <= (size_t(1) << bits) / 4 * 3) ? index - 1 : index;
+        }
+        size_t classSize(size_t index)
+        {
+            return (index % 2 == 0) ? ES_POOL_SIZE_MIN << (index / 2) : (ES_POOL_SIZE_MIN << (index / 2 + 1)) / 4 * 3;
+        }
+        size_t cacheCapacity(size_t index) { return std::clamp(ES_POOL_CACHE_BYTES / classSize(index), size_t(2), size_t(256)); }
+
+        struct Counters
+        {
+            std::atomic<uint64_t> threadCacheHits = 0, sharedHits = 0, misses = 0, heapAllocations = 0;
+            std::atomic<int64_t> bytesInUse = 0; // a thread may free more than it allocated, the total is what counts
+        };
+
+        struct ThreadCache;
+        struct SharedClass
+        {
+            std::mutex mutex;
+            std::vector<char*> freeBlocks;
+        };
+        struct Shared
+        {
+            std::array<std::array<SharedClass, ES_POOL_CLASSES>, ES_POOL_NODE_SLOTS> classes;
+            std::atomic<size_t> slabBytes = 0;
+            std::mutex cachesMutex;
+            std::vector<ThreadCache*> caches;
+            Counters retired; // of threads that have exited, and of allocations made while a thread is exiting
+            std::mutex slabsMutex;
+            std::vector<char*> slabs; // kept reachable, the pool's memory is owned rather than leaked
+        };
+        // never destroyed, buffers of static objects are freed after every other static object has been
+        Shared& shared()
+        {
+            static Shared* instance = new Shared();
+            return *instance;
+        }
+
+        // moves up to count free blocks of the class into out, carving a new slab if there are none, returns false on a miss
+        bool takeShared(size_t nodeSlot, size_t index, std::vector<char*>& out, size_t count)
+        {
+            SharedClass& sharedClass = shared().classes[nodeSlot][index];
+            std::lock_guard lock{ sharedClass.mutex };
+            const bool hit = not sharedClass.freeBlocks.empty();
+            if (not hit)
+            {
+                const size_t blockSize = classSize(index);
+                char* slab = static_cast<char*>(::operator new(ES_POOL_SLAB_SIZE, std::align_val_t{ ES_POOL_SLAB_SIZE }));
+                // touched while the node is preferred, so the pages are placed there and not wherever a block is first written
+                if (nodeSlot != 0)
+                    memset(slab, 0x00, ES_POOL_SLAB_SIZE);
+                reinterpret_cast<SlabHeader*>(slab)->nodeSlot = nodeSlot;
+                {
+                    std::lock_guard slabsLock{ shared().slabsMutex };
+                    shared().slabs.push_back(slab);
+                }
+                shared().slabBytes.fetch_add(ES_POOL_SLAB_SIZE, std::memory_order_relaxed);
+                // carved back to front, so blocks are handed out in address order
+                const size_t carvedEnd = ES_POOL_SLAB_HEADER_SIZE + (ES_POOL_SLAB_SIZE - ES_POOL_SLAB_HEADER_SIZE) / blockSize * blockSize;
+                for (size_t offset = carvedEnd; offset > ES_POOL_SLAB_HEADER_SIZE; offset -= blockSize)
+                    sharedClass.freeBlocks.push_back(slab + offset - blockSize);
+            }
+            const size_t moved = std::min(count, sharedClass.freeBlocks.size());
+            out.insert(out.end(), sharedClass.freeBlocks.end() - moved, sharedClass.freeBlocks.end());
+            sharedClass.freeBlocks.resize(sharedClass.freeBlocks.size() - moved);
+            return hit;
+        }
+        void returnShared(size_t nodeSlot, size_t index, char* const* blocks, size_t count)
+        {
+            SharedClass& sharedClass = shared().classes[nodeSlot][index];
+            std::lock_guard lock{ sharedClass.mutex };
+            sharedClass.freeBlocks.insert(sharedClass.freeBlocks.end(), blocks, blocks + count);
+        }
+
+        thread_local bool threadCacheDestroyed = false; // trivially destructible, so it is still readable after the cache is gone
+
+        struct ThreadCache
+        {
+            std::array<std::array<std::vector<char*>, ES_POOL_CLASSES>, ES_POOL_NODE_SLOTS> freeBlocks;
+            Counters counters;
+
+            ThreadCache()
+            {
+                std::lock_guard lock{ shared().cachesMutex };
+                shared().caches.push_back(this);
+            }
+            ~ThreadCache()
+            {
+                for (size_t nodeSlot = 0; nodeSlot < ES_POOL_NODE_SLOTS; nodeSlot++)
+                {
+                    for (size_t index = 0; index < ES_POOL_CLASSES; index++)
+                    {
+                        std::vector<char*>& blocks = freeBlocks[nodeSlot][index];
+                        if (not blocks.empty())
+                            returnShared(nodeSlot, index, blocks.data(), blocks.size());
+                    }
+                }
+                std::lock_guard lock{ shared().cachesMutex };
+                Counters& retired = shared().retired;
+                retired.threadCacheHits += counters.threadCacheHits;
+                retired.sharedHits += counters.sharedHits;
+                retired.misses += counters.misses;
+                retired.heapAllocations += counters.heapAllocations;
+                retired.bytesInUse += counters.bytesInUse;
+                std::erase(shared().caches, this);
+                threadCacheDestroyed = true;
+            }
+        };
+
+        // nullptr while the thread is exiting, its blocks then go straight to the shared lists
+        ThreadCache* threadCache()
+        {
+            if (threadCacheDestroyed)
+                return nullptr;
+            thread_local ThreadCache cache;
+            return &cache;
+        }
+    }
+
+    char* allocate(size_t size)
+    {
+        ThreadCache* cache = threadCache();
+        Counters& counters = cache ? cache->counters : shared().retired;
+        if (size > ES_POOL_SIZE_MAX)
+        {
+            counters.heapAllocations.fetch_add(1, std::memory_order_relaxed);
+            return new char[size];
+        }
+        const size_t index = classIndex(size);
+        const size_t nodeSlot = preferredNodeSlot();
+        counters.bytesInUse.fetch_add((int64_t)classSize(index), std::memory_order_relaxed);
+        if (cache and not cache->freeBlocks[nodeSlot][index].empty())
+        {
+            counters.threadCacheHits.fetch_add(1, std::memory_order_relaxed);
+            char* block = cache->freeBlocks[nodeSlot][index].back();
+            cache->freeBlocks[nodeSlot][index].pop_back();
+            return block;
+        }
+        // refills half the cache at once, the next allocations of the class do not touch the shared list
+        std::vector<char*> single;
+        std::vector<char*>& refill = cache ? cache->freeBlocks[nodeSlot][index] : single;
+        const bool hit = takeShared(nodeSlot, index, refill, cache ? cacheCapacity(index) / 2 : 1);
+        (hit ? counters.sharedHits : counters.misses).fetch_add(1, std::memory_order_relaxed);
+        char* block = refill.back();
+        refill.pop_back();
+        return block;
+    }
+
+    void deallocate(char* block, size_t size)
+    {
+        if (not block)
+            return;
+        if (size > ES_POOL_SIZE_MAX)
+        {
+            delete[] block;
+            return;
+        }
+        const size_t index = classIndex(size);
+        const size_t nodeSlot = nodeSlotOfBlock(block); // back to the node the block is on, whichever thread frees it
+        ThreadCache* cache = threadCache();
+        Counters& counters = cache ? cache->counters : shared().retired;
+        counters.bytesInUse.fetch_sub((int64_t)classSize(index), std::memory_order_relaxed);
+        if (not cache)
+        {
+            returnShared(nodeSlot, index, &block, 1);
+            return;
+        }
+        // a thread freeing more than it allocates, such as the consumer of a stream's buffer, returns the least recently freed half
+        std::vector<char*>& freeBlocks = cache->freeBlocks[nodeSlot][index];
+        freeBlocks.push_back(block);
+        if (freeBlocks.size() > cacheCapacity(index))
+        {
+            const size_t returned = freeBlocks.size() / 2;
+            returnShared(nodeSlot, index, freeBlocks.data(), returned);
+            freeBlocks.erase(freeBlocks.begin(), freeBlocks.begin() + returned);
+        }
+    }
+
+    size_t usableSize(size_t size)
+    {
+        return (size > ES_POOL_SIZE_MAX) ? size : classSize(classIndex(size));
+    }
+
+    Stats getStats()
+    {
+        Stats stats;
+        int64_t bytesInUse = 0;
+        const auto add = [&](const Counters& counters)
+        {
+            stats.threadCacheHits += counters.threadCacheHits.load(std::memory_order_relaxed);
+            stats.sharedHits += counters.sharedHits.load(std::memory_order_relaxed);
+            stats.misses += counters.misses.load(std::memory_order_relaxed);
+            stats.heapAllocations += counters.heapAllocations.load(std::memory_order_relaxed);
+            bytesInUse += counters.bytesInUse.load(std::memory_order_relaxed);
+        };
+        std::lock_guard lock{ shared().cachesMutex };
+        add(shared().retired);
+        for (const ThreadCache* cache : shared().caches)
+            add(cache->counters);
+        stats.slabBytes = shared().slabBytes.load(std::memory_order_relaxed);
+        stats.bytesInUse = (size_t)std::max(bytesInUse, int64_t(0));
+        return stats;
+    }
+}
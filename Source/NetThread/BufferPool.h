@@ -0,0 +1,46 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#pragma once
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+// size-class pool for the byte buffers of connections (stream buffers, TLS buffers, receive scratch), so connection churn reuses
+// memory instead of going through the global allocator for every buffer opened, grown and closed
+// sizes are rounded up to a class (powers of two and the midpoints between them), blocks are carved from large slabs
+// each thread keeps a small cache of free blocks per class, only moving blocks to and from the shared lists in batches,
+// a block may be freed by another thread than the one that allocated it, slabs are kept for reuse and never returned
+// free blocks are kept per NUMA node, an allocation takes a block of the node preferred for the calling thread (see
+// ThreadPlacement), so buffers allocated for a worker on another node are local to it even when they are reused
+namespace BufferPool
+{
+    constexpr size_t ES_POOL_SIZE_MIN = 64;
+    // larger buffers come straight from the heap, they are rare and would sit idle in the pool between uses
+    constexpr size_t ES_POOL_SIZE_MAX = 256 * 1024;
+
+    // threadsafe, at least size bytes, aligned for any type
+    char* allocate(size_t size);
+    // threadsafe, size must be the size the block was allocated with
+    void deallocate(char* block, size_t size);
+    // the size of the class an allocation of size comes from, the extra bytes are usable
+    size_t usableSize(size_t size);
+
+    struct Stats
+    {
+        uint64_t threadCacheHits = 0; // served from the calling thread's cache
+        uint64_t sharedHits = 0; // served from blocks returned by other threads, or overflowing from their caches
+        uint64_t misses = 0; // no free block in the class, a new slab was carved
+        uint64_t heapAllocations = 0; // larger than the largest class
+        size_t slabBytes = 0; // memory held by the pool, its footprint apart from the heap allocations
+        size_t bytesInUse = 0; // class sizes of the blocks allocated and not yet freed
+    };
+    // threadsafe, a snapshot of all threads' counters
+    Stats getStats();
+
+    struct Deleter
+    {
+        size_t size = 0;
+        void operator()(char* block) const { deallocate(block, size); }
+    };
+    using Buffer = std::unique_ptr<char[], Deleter>;
+    inline Buffer makeBuffer(size_t size) { return Buffer(allocate(size), Deleter{ size }); }
+}
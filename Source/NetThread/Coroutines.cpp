@@ -0,0 +1,104 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#include "Coroutines.h"
+#include <chrono>
+
+namespace
+{
+    thread_local CoroutineScheduler* currentScheduler = nullptr;
+}
+
+void CoroutineDetail::ReadyQueue::push(std::coroutine_handle<> handle)
+{
+    numReady.fetch_add(1, std::memory_order_seq_cst); // counted first, a run seeing the count keeps popping until the push lands
+    handles.push(handle);
+    if (sleeping.load(std::memory_order_seq_cst))
+    {
+        { std::lock_guard<std::mutex> lock(sleepMutex); }
+        readied.notify_one();
+    }
+}
+
+CoroutineScheduler::CoroutineScheduler()
+    : readyQueue{ std::make_shared<CoroutineDetail::ReadyQueue>() }
+{
+}
+
+CoroutineScheduler::~CoroutineScheduler()
+{
+    assert(currentScheduler != this && "a scheduler must not be destroyed by a coroutine it runs");
+}
+
+void CoroutineScheduler::spawn(NetTask<void> task)
+{
+    auto handle = std::exchange(task.handle, nullptr);
+    if (not handle)
+        return;
+    handle.promise().detachedOn = this;
+    numSpawned.fetch_add(1, std::memory_order_relaxed);
+    schedule(handle);
+}
+
+size_t CoroutineScheduler::runFor(int timeoutMs)
+{
+    size_t numResumed = resumeReady();
+    if (numResumed > 0 or timeoutMs <= 0)
+        return numResumed;
+
+    CoroutineDetail::ReadyQueue& queue = *readyQueue;
+    {
+        std::unique_lock<std::mutex> lock(queue.sleepMutex);
+        queue.sleeping.store(true, std::memory_order_seq_cst);
+        queue.readied.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+                               [&queue] { return queue.numReady.load(std::memory_order_seq_cst) > 0; });
+        queue.sleeping.store(false, std::memory_order_relaxed);
+    }
+    return resumeReady();
+}
+
+void CoroutineScheduler::run()
+{
+    while (numTasks() > 0)
+        runFor(100);
+}
+
+CoroutineScheduler* CoroutineScheduler::current()
+{
+    return currentScheduler;
+}
+
+size_t CoroutineScheduler::resumeReady()
+{
+    CoroutineScheduler* previous = std::exchange(currentScheduler, this);
+    CoroutineDetail::ReadyQueue& queue = *readyQueue;
+    size_t numResumed = 0;
+    // only the coroutines ready when the run started, one that keeps readying itself must not starve the caller
+    size_t budget = queue.numReady.load(std::memory_order_acquire);
+    std::coroutine_handle<> handle;
+    while (budget > 0)
+    {
+        if (not queue.handles.pop(handle))
+            continue; // counted, but the push has not landed yet
+        queue.numReady.fetch_sub(1, std::memory_order_relaxed);
+        budget--;
+        handle.resume();
+        numResumed++;
+    }
+    currentScheduler = previous;
+    return numResumed;
+}
+
+bool ActivityAwaiter::await_suspend(std::coroutine_handle<> awaiting)
+{
+    CoroutineScheduler* scheduler = CoroutineScheduler::current();
+    assert(scheduler && "network operations must be awaited from a coroutine run by a CoroutineScheduler");
+    struct Wake { std::shared_ptr<CoroutineDetail::ReadyQueue> queue; std::coroutine_handle<> handle; std::atomic<bool> woken = false; };
+    auto wake = std::make_shared<Wake>();
+    wake->queue = scheduler->getReadyQueue();
+    wake->handle = awaiting;
+
+    watch([wake] { if (not wake->woken.exchange(true)) wake->queue->push(wake->handle); });
+    registered = true;
+    if (condition() and not wake->woken.exchange(true))
+        return false; // the condition holds already and no activity has queued the coroutine, it continues right away
+    return true;
+}
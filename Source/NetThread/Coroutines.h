@@ -0,0 +1,173 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#pragma once
+#include "NetThread/MpscQueue.h"
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <type_traits>
+#include <utility>
+#include <cassert>
+
+class CoroutineScheduler;
+
+namespace CoroutineDetail
+{
+    // coroutines ready to resume, shared with the wake callbacks so a late callback never outlives it
+    struct ReadyQueue
+    {
+        MpscQueue<std::coroutine_handle<>> handles;
+        std::atomic<size_t> numReady = 0;
+        std::atomic<bool> sleeping = false;
+        std::mutex sleepMutex;
+        std::condition_variable readied;
+
+        void push(std::coroutine_handle<> handle);
+    };
+
+    struct PromiseBase
+    {
+        std::coroutine_handle<> continuation = nullptr; // resumed once the task completes
+        CoroutineScheduler* detachedOn = nullptr; // spawned tasks have no continuation and destroy themselves once completed
+        std::exception_ptr exception = nullptr;
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        struct FinalAwaiter
+        {
+            bool await_ready() noexcept { return false; }
+            template<typename Promise>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept;
+            void await_resume() noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        void unhandled_exception() { exception = std::current_exception(); }
+    };
+
+    template<typename T>
+    struct Promise : PromiseBase
+    {
+        std::optional<T> value;
+        template<typename U>
+        void return_value(U&& result) { value.emplace(std::forward<U>(result)); }
+        T take() { if (exception) std::rethrow_exception(exception); return std::move(*value); }
+    };
+
+    template<>
+    struct Promise<void> : PromiseBase
+    {
+        void return_void() {}
+        void take() { if (exception) std::rethrow_exception(exception); }
+    };
+}
+
+// coroutine result type for network operations, the coroutine starts once it is awaited or spawned on a scheduler
+// the awaiting coroutine resumes as soon as the task completes, on the thread which completed it
+template<typename T = void>
+class NetTask
+{
+public:
+    struct promise_type : CoroutineDetail::Promise<T>
+    {
+        NetTask get_return_object() { return NetTask{ std::coroutine_handle<promise_type>::from_promise(*this) }; }
+    };
+
+    NetTask(NetTask&& other) noexcept : handle{ std::exchange(other.handle, nullptr) } {}
+    NetTask& operator=(NetTask&& other) noexcept
+    {
+        if (this != &other)
+        {
+            if (handle)
+                handle.destroy();
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+    NetTask(const NetTask&) = delete;
+    NetTask& operator=(const NetTask&) = delete;
+    ~NetTask() { if (handle) handle.destroy(); }
+
+    bool await_ready() const noexcept { return not handle or handle.done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        handle.promise().continuation = awaiting;
+        return handle; // starts the task, it transfers back to the awaiting coroutine once completed
+    }
+    T await_resume() { return handle.promise().take(); }
+
+private:
+    friend class CoroutineScheduler;
+    explicit NetTask(std::coroutine_handle<promise_type> handle) : handle{ handle } {}
+    std::coroutine_handle<promise_type> handle = nullptr;
+};
+
+// runs coroutines on the thread calling run or runFor, coroutines waiting for network activity are queued back by the I/O threads
+// awaitables of connections and agents must be awaited from coroutines run by a scheduler, run and runFor must only be called from
+// one thread at a time
+class CoroutineScheduler
+{
+public:
+    CoroutineScheduler();
+    ~CoroutineScheduler(); // tasks still suspended are abandoned, their frames are not destroyed
+    CoroutineScheduler(const CoroutineScheduler&) = delete;
+    CoroutineScheduler& operator=(const CoroutineScheduler&) = delete;
+
+    // threadsafe, the task starts on the next run, an exception escaping a spawned task terminates the program
+    void spawn(NetTask<void> task);
+    // threadsafe, queues a suspended coroutine to be resumed on the next run
+    void schedule(std::coroutine_handle<> handle) { readyQueue->push(handle); }
+
+    // resumes the coroutines ready to run, if none are ready waits up to timeoutMs for one, returns the number resumed
+    size_t runFor(int timeoutMs);
+    // runs until every spawned task has completed
+    void run();
+    size_t numTasks() const { return numSpawned.load(std::memory_order_acquire); }
+
+    // the scheduler running coroutines on this thread, nullptr outside of run and runFor
+    static CoroutineScheduler* current();
+    std::shared_ptr<CoroutineDetail::ReadyQueue> getReadyQueue() const { return readyQueue; }
+
+protected:
+    friend struct CoroutineDetail::PromiseBase::FinalAwaiter;
+    size_t resumeReady();
+    std::shared_ptr<CoroutineDetail::ReadyQueue> readyQueue;
+    std::atomic<size_t> numSpawned = 0;
+};
+
+template<typename Promise>
+std::coroutine_handle<> CoroutineDetail::PromiseBase::FinalAwaiter::await_suspend(std::coroutine_handle<Promise> handle) noexcept
+{
+    PromiseBase& promise = handle.promise();
+    if (promise.continuation)
+        return promise.continuation;
+    if (CoroutineScheduler* scheduler = promise.detachedOn)
+    {
+        if (promise.exception)
+            std::rethrow_exception(promise.exception); // terminates, nobody awaits a spawned task
+        handle.destroy();
+        scheduler->numSpawned.fetch_sub(1, std::memory_order_release);
+    }
+    return std::noop_coroutine();
+}
+
+// suspends the awaiting coroutine until the next activity of a source, or not at all if the condition already holds
+// watch registers the callback the source calls on activity, from any thread, and removes it when passed nullptr
+// the condition is checked again after registering, so activity between the first check and suspending is not missed
+class ActivityAwaiter
+{
+public:
+    using Watch = std::function<void(std::function<void()>)>;
+    ActivityAwaiter(Watch watch, std::function<bool()> condition) : watch{ std::move(watch) }, condition{ std::move(condition) } {}
+
+    bool await_ready() { return condition(); }
+    bool await_suspend(std::coroutine_handle<> awaiting);
+    void await_resume() { if (registered) watch(nullptr); }
+
+private:
+    Watch watch;
+    std::function<bool()> condition;
+    bool registered = false;
+};
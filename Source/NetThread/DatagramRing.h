@@ -0,0 +1,58 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#pragma once
+#include "Sockets/Sockets.h"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// fixed ring of preallocated datagram slots, handed from one producer thread to one consumer thread without locking or allocating
+// slots are filled and published, then read and released, in ring order
+class DatagramRing
+{
+public:
+    struct Slot
+    {
+        char* data = nullptr; // slot storage, getSlotCapacity bytes
+        size_t size = 0;
+        size_t offset = 0; // consumer progress within the slot, for messages that are consumed in parts
+        Sockets::SocketAddress address{};
+        uint16_t segmentSize = 0; // the slot holds a run of datagrams of this size (UDP GSO/GRO)
+    };
+
+    // allocates all slots up front, the number of slots is rounded up to a power of two, not threadsafe
+    void init(size_t numSlots, size_t slotCapacity)
+    {
+        size_t size = 1;
+        while (size < numSlots)
+            size <<= 1;
+        slots.assign(size, Slot{});
+        storage = std::make_unique<char[]>(size * slotCapacity);
+        for (size_t i = 0; i < size; i++)
+            slots[i].data = storage.get() + i * slotCapacity;
+        capacity = slotCapacity;
+        mask = size - 1;
+        writeIndex.store(0, std::memory_order_relaxed);
+        readIndex.store(0, std::memory_order_relaxed);
+    }
+    size_t getSlotCapacity() const { return capacity; }
+
+    // producer: number of slots that can be filled, the i-th free slot counts from the oldest free slot
+    size_t numFree() const { return slots.size() - (writeIndex.load(std::memory_order_relaxed) - readIndex.load(std::memory_order_acquire)); }
+    Slot& freeSlot(size_t i) { return slots[(writeIndex.load(std::memory_order_relaxed) + i) & mask]; }
+    // producer: makes the first count free slots visible to the consumer
+    void publish(size_t count) { writeIndex.store(writeIndex.load(std::memory_order_relaxed) + count, std::memory_order_release); }
+
+    // consumer: number of slots ready to be read, the i-th ready slot counts from the oldest published slot
+    size_t numReady() const { return writeIndex.load(std::memory_order_acquire) - readIndex.load(std::memory_order_relaxed); }
+    Slot& readySlot(size_t i) { return slots[(readIndex.load(std::memory_order_relaxed) + i) & mask]; }
+    // consumer: returns the first count ready slots to the producer
+    void release(size_t count) { readIndex.store(readIndex.load(std::memory_order_relaxed) + count, std::memory_order_release); }
+
+private:
+    std::vector<Slot> slots;
+    std::unique_ptr<char[]> storage = nullptr;
+    size_t capacity = 0;
+    size_t mask = 0;
+    alignas(64) std::atomic<size_t> writeIndex = 0; // indices only grow, separate cache lines keep the two threads from contending
+    alignas(64) std::atomic<size_t> readIndex = 0;
+};
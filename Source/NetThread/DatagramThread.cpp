@@ -0,0 +1,257 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#include "DatagramThread.h"
+#include "NetThreadSync.h"
+#include "NetAgent/Agent.h"
+#include "NetAgent/HttpServerUtils/Logging.h"
+#include <cassert>
+#include <array>
+#include <cstring>
+#include <cerrno>
+
+#ifdef __linux__
+	#include <sys/eventfd.h>
+#endif
+#ifndef _WIN32
+	#include <poll.h>
+#endif
+
+// upper bound for waiting on the socket, only matters where the thread cannot be woken through an eventfd (milliseconds)
+constexpr int ES_DATAGRAM_POLL_MAX_MS = 100;
+constexpr int ES_DATAGRAM_POLL_FALLBACK_MS = 1;
+// largest message the kernel delivers when coalescing received datagrams (UDP GRO)
+constexpr size_t ES_DATAGRAM_COALESCED_MAX = 65535;
+
+DatagramThread::DatagramThread()
+{
+#ifdef __linux__
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+}
+
+DatagramThread::~DatagramThread()
+{
+    stop();
+    if (thread.joinable())
+        thread.join();
+    Sockets::closeSocket(socket);
+#ifdef __linux__
+    if (wakeFd != -1)
+        close(wakeFd);
+#endif
+}
+
+bool DatagramThread::start(std::string_view port, std::string_view hostname, const std::shared_ptr<NetAgentSettings>& settings_)
+{
+    settings = settings_ ? settings_ : std::make_shared<NetAgentSettings>();
+    if (not Sockets::createDatagramSocket(socket, std::string(port), std::string(hostname)))
+    {
+        ESLog::es_error(ESLog::FormatStr() << "Failed to create datagram socket on port " << port);
+        return false;
+    }
+
+    size_t receiveCapacity = settings->datagramSlotSize;
+    if (settings->datagramReceiveCoalescing)
+    {
+        if (Sockets::enableDatagramCoalescing(socket))
+            receiveCapacity = ESMax(receiveCapacity, ES_DATAGRAM_COALESCED_MAX);
+        else
+            ESLog::es_warning("UDP receive coalescing is not available, datagrams are received individually");
+    }
+    segmentationSupported = Sockets::datagramSegmentationSupported(socket);
+    receiveRing.init(settings->datagramRingSlots, receiveCapacity);
+    sendRing.init(settings->datagramRingSlots, settings->datagramSlotSize);
+
+    thread = std::thread([this] { this->threadMain(); }); // create thread
+    return true;
+}
+
+size_t DatagramThread::receive(const std::function<void(const Datagram&)>& handler, size_t maxCount)
+{
+    const size_t numMessages = ESMin(receiveRing.numReady(), maxCount);
+    size_t numDatagrams = 0;
+    for (size_t i = 0; i < numMessages; i++)
+    {
+        const DatagramRing::Slot& slot = receiveRing.readySlot(i);
+        // coalesced messages are split back into the datagrams they were received as
+        const size_t segmentSize = (slot.segmentSize > 0) ? slot.segmentSize : slot.size;
+        size_t offset = 0;
+        do
+        {
+            const size_t size = ESMin(segmentSize, slot.size - offset);
+            handler(Datagram{ .data = std::string_view(slot.data + offset, size), .from = &slot.address });
+            offset += size;
+            numDatagrams++;
+        } while (offset < slot.size);
+    }
+    receiveRing.release(numMessages);
+
+    if (numMessages > 0 and receiveStalled.exchange(false))
+        wake(); // the thread stopped receiving while the ring was full
+    return numDatagrams;
+}
+
+bool DatagramThread::send(const Sockets::SocketAddress& to, std::string_view data, size_t segmentSize)
+{
+    if (data.size() > sendRing.getSlotCapacity() or segmentSize > UINT16_MAX)
+        return false;
+    if (segmentSize > 0 and (data.size() + segmentSize - 1) / segmentSize > Sockets::ES_DATAGRAM_SEGMENTS_MAX)
+        return false;
+    {
+        std::lock_guard<std::mutex> lock(sendMutex);
+        if (sendRing.numFree() == 0)
+            return false;
+        DatagramRing::Slot& slot = sendRing.freeSlot(0);
+        memcpy(slot.data, data.data(), data.size());
+        slot.size = data.size();
+        slot.offset = 0;
+        slot.address = to;
+        slot.segmentSize = (segmentSize < data.size()) ? (uint16_t)segmentSize : 0;
+        sendRing.publish(1);
+    }
+    if (not wakePending.exchange(true))
+        wake();
+    return true;
+}
+
+void DatagramThread::threadMain()
+{
+	WIN_SET_THREAD_NAME(L"Datagram Thread");
+    while (!forceTerminate)
+    {
+        wakePending = false; // sends published from here on wake the thread again
+        bool progress = receiveBatch();
+        progress = sendBatch() or progress;
+        if (not progress)
+            waitForActivity(ES_DATAGRAM_POLL_MAX_MS);
+    }
+}
+
+bool DatagramThread::receiveBatch()
+{
+    std::array<Sockets::DatagramMessage, Sockets::ES_DATAGRAM_BATCH_MAX> messages;
+    const size_t numFree = ESMin(receiveRing.numFree(), messages.size());
+    if (numFree == 0)
+        return false;
+    for (size_t i = 0; i < numFree; i++)
+    {
+        DatagramRing::Slot& slot = receiveRing.freeSlot(i);
+        messages[i] = Sockets::DatagramMessage{ .data = slot.data, .size = receiveRing.getSlotCapacity(), .address = &slot.address };
+    }
+
+    const int32_t numReceived = Sockets::receiveDatagrams(socket, messages.data(), numFree);
+    if (numReceived <= 0)
+        return false;
+    for (int32_t i = 0; i < numReceived; i++)
+    {
+        DatagramRing::Slot& slot = receiveRing.freeSlot(i);
+        slot.size = messages[i].size;
+        slot.segmentSize = messages[i].segmentSize;
+    }
+    receiveRing.publish((size_t)numReceived);
+    return true;
+}
+
+bool DatagramThread::sendBatch()
+{
+    std::array<Sockets::DatagramMessage, Sockets::ES_DATAGRAM_BATCH_MAX> messages;
+    std::array<size_t, Sockets::ES_DATAGRAM_BATCH_MAX> messageSlots; // index of the ready slot each message is sent from
+    const size_t numReady = sendRing.numReady();
+    size_t numMessages = 0;
+    for (size_t i = 0; i < numReady and numMessages < messages.size(); i++)
+    {
+        DatagramRing::Slot& slot = sendRing.readySlot(i);
+        if (slot.segmentSize == 0 or segmentationSupported)
+        {
+            messages[numMessages] = Sockets::DatagramMessage{ .data = slot.data, .size = slot.size, .address = &slot.address,
+                                                              .segmentSize = slot.segmentSize };
+            messageSlots[numMessages++] = i;
+            continue;
+        }
+        // without UDP_SEGMENT the run of datagrams is sent as separate messages of the same batch
+        for (size_t offset = slot.offset; offset < slot.size and numMessages < messages.size(); offset += slot.segmentSize)
+        {
+            messages[numMessages] = Sockets::DatagramMessage{ .data = slot.data + offset,
+                                                              .size = ESMin((size_t)slot.segmentSize, slot.size - offset),
+                                                              .address = &slot.address };
+            messageSlots[numMessages++] = i;
+        }
+    }
+    if (numMessages == 0)
+        return false;
+
+    int32_t numSent = Sockets::sendDatagrams(socket, messages.data(), numMessages);
+    if (numSent < 0)
+    {
+        if (Sockets::lastErrorWouldBlock())
+        {
+            sendWouldBlock = true;
+            return false;
+        }
+        if (messages[0].segmentSize > 0 and errno == EIO)
+        {
+            // the route does not support segmentation offload after all, the runs are split here from now on
+            segmentationSupported = false;
+            ESLog::es_warning("UDP segmentation offload failed, sending datagrams individually");
+            return true;
+        }
+        // datagrams are unreliable, a message that cannot be sent (unreachable, too large) is dropped instead of blocking the ring
+        ESLog::es_detail(ESLog::FormatStr() << "Dropped datagram to " << messages[0].address->toString() << ", send failed");
+        numSent = 1;
+    }
+
+    // release the slots whose messages were all sent, a partially sent run resumes from its offset
+    size_t numCompleted = 0;
+    for (int32_t m = 0; m < numSent; m++)
+    {
+        DatagramRing::Slot& slot = sendRing.readySlot(messageSlots[m]);
+        slot.offset = (size_t)(messages[m].data - slot.data) + messages[m].size;
+        if (slot.offset >= slot.size)
+            numCompleted = messageSlots[m] + 1;
+    }
+    sendRing.release(numCompleted);
+    return true;
+}
+
+void DatagramThread::waitForActivity(int timeoutMs)
+{
+    // the receive ring being full must be seen by receive before this thread stops receiving, or no one would wake it
+    bool canReceive = receiveRing.numFree() > 0;
+    if (not canReceive)
+    {
+        receiveStalled = true;
+        canReceive = receiveRing.numFree() > 0;
+    }
+    const bool wantSend = sendWouldBlock and sendRing.numReady() > 0;
+    sendWouldBlock = false;
+#ifdef _WIN32
+    WSAPOLLFD fd{};
+    fd.fd = socket;
+    fd.events = (canReceive ? POLLRDNORM : 0) | (wantSend ? POLLWRNORM : 0);
+    WSAPoll(&fd, 1, ESMin(timeoutMs, ES_DATAGRAM_POLL_FALLBACK_MS)); // sends cannot wake the thread
+#else
+    const short socketEvents = (canReceive ? POLLIN : 0) | (wantSend ? POLLOUT : 0);
+    pollfd fds[2]{};
+    nfds_t numFds = 0;
+    if (wakeFd != -1)
+        fds[numFds++] = pollfd{ .fd = wakeFd, .events = POLLIN, .revents = 0 };
+    fds[numFds++] = pollfd{ .fd = socket, .events = socketEvents, .revents = 0 };
+    poll(fds, numFds, (wakeFd != -1) ? timeoutMs : ESMin(timeoutMs, ES_DATAGRAM_POLL_FALLBACK_MS));
+    #ifdef __linux__
+    if (wakeFd != -1 and (fds[0].revents & POLLIN))
+    {
+        uint64_t counter = 0;
+        [[maybe_unused]] auto r = read(wakeFd, &counter, sizeof(counter));
+    }
+    #endif
+#endif
+}
+
+void DatagramThread::wake()
+{
+#ifdef __linux__
+    if (wakeFd == -1)
+        return;
+    const uint64_t one = 1;
+    [[maybe_unused]] auto r = write(wakeFd, &one, sizeof(one));
+#endif
+}
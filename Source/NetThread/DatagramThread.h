@@ -0,0 +1,62 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#pragma once
+#include "Sockets/Sockets.h"
+#include "NetThread/DatagramRing.h"
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <string_view>
+
+class NetAgentSettings;
+
+// a received datagram, only valid while the receive handler runs
+struct Datagram
+{
+    std::string_view data{};
+    const Sockets::SocketAddress* from = nullptr;
+};
+
+// UDP socket op thread class, datagrams are received and sent in batches (recvmmsg/sendmmsg) through rings of preallocated slots
+class DatagramThread
+{
+public:
+    DatagramThread();
+    ~DatagramThread();
+
+    // binds the socket and starts the thread, returns false if the socket could not be created
+    bool start(std::string_view port, std::string_view hostname, const std::shared_ptr<NetAgentSettings>& settings);
+    void stop() { forceTerminate = true; wake(); } // forces the datagram thread to shut down
+
+    // calls the handler for each received datagram, up to maxCount received messages, returns the number of datagrams handled
+    // must only be called from one thread at a time
+    size_t receive(const std::function<void(const Datagram&)>& handler, size_t maxCount);
+    // threadsafe, copies the data into a send slot, returns false if the send ring is full or the data does not fit in a slot
+    // with a segment size the data is sent as a run of datagrams of that size, split by the kernel where supported (UDP GSO)
+    bool send(const Sockets::SocketAddress& to, std::string_view data, size_t segmentSize = 0);
+
+protected:
+    void threadMain();
+    std::thread thread;
+    std::atomic<bool> forceTerminate = false;
+    SOCKET socket = INVALID_SOCKET;
+    std::shared_ptr<NetAgentSettings> settings = nullptr;
+
+    // each returns true if any datagram was moved
+    bool receiveBatch();
+    bool sendBatch();
+    bool sendWouldBlock = false; // wait for the socket to become writable before sending again
+    // waits until the socket is ready for the pending work, the thread is woken, or the timeout expires
+    void waitForActivity(int timeoutMs);
+    void wake();
+
+    DatagramRing receiveRing; // produced by the datagram thread, consumed by receive
+    DatagramRing sendRing; // produced by send, consumed by the datagram thread
+    std::mutex sendMutex; // several threads may send
+    std::atomic<bool> wakePending = false; // sends only wake the thread once per batch instead of once per datagram
+    std::atomic<bool> receiveStalled = false; // the receive ring was full, receive wakes the thread after freeing slots
+    bool segmentationSupported = false;
+
+    int wakeFd = -1; // eventfd, signalled by stop(), send and receive
+};
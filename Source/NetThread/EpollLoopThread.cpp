@@ -0,0 +1,140 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#include "EpollLoopThread.h"
+#include "StreamThread.h"
+#include "NetAgent/HttpServerUtils/Logging.h"
+#include <cassert>
+
+#ifdef __linux__
+	#include <sys/epoll.h>
+	#include <sys/eventfd.h>
+#endif
+
+// maximum number of readiness events processed per wakeup
+constexpr int ES_EPOLL_BATCH_SIZE = 256;
+
+EpollLoopThread::~EpollLoopThread()
+{
+	join();
+#ifdef __linux__
+	if (wakeFd != -1)
+		close(wakeFd);
+	if (epollFd != -1)
+		close(epollFd);
+#endif
+}
+
+#ifdef __linux__
+
+bool EpollLoopThread::isSupported() { return true; }
+
+bool EpollLoopThread::start()
+{
+	epollFd = epoll_create1(EPOLL_CLOEXEC);
+	wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (epollFd == -1 or wakeFd == -1)
+	{
+		ESLog::es_error("Event loop could not be created");
+		return false;
+	}
+	epoll_event ev{};
+	ev.events = EPOLLIN | EPOLLET;
+	ev.data.u64 = 0; // key 0 is the eventfd
+	if (epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev) != 0)
+		return false;
+
+	thread = std::thread([this] { this->threadMain(); }); // create thread
+	return true;
+}
+
+bool EpollLoopThread::registerSocket(uint64_t key, SOCKET s)
+{
+	epoll_event ev{};
+	ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+	ev.data.u64 = key;
+	return epoll_ctl(epollFd, EPOLL_CTL_ADD, s, &ev) == 0;
+}
+
+void EpollLoopThread::unregisterSocket(uint64_t /*key*/, SOCKET s)
+{
+	epoll_ctl(epollFd, EPOLL_CTL_DEL, s, nullptr);
+}
+
+void EpollLoopThread::wake()
+{
+	if (wakeFd == -1)
+		return;
+	const uint64_t one = 1;
+	[[maybe_unused]] auto r = write(wakeFd, &one, sizeof(one));
+}
+
+void EpollLoopThread::threadMain()
+{
+	WIN_SET_THREAD_NAME(L"Event Loop Thread");
+	applyPlacement();
+	std::vector<epoll_event> events(ES_EPOLL_BATCH_SIZE);
+	std::vector<uint64_t> sendKeys;
+	Timer tickTimer;
+	tickTimer.start();
+
+	while (!forceTerminate)
+	{
+		const int numEvents = epoll_wait(epollFd, events.data(), (int)events.size(), ES_EVENT_LOOP_TICK_MS);
+		if (numEvents < 0 and errno != EINTR)
+		{
+			ESLog::es_error("Event loop terminating: epoll_wait failed");
+			break;
+		}
+
+		for (int i = 0; i < numEvents; i++)
+		{
+			const uint64_t key = events[i].data.u64;
+			if (key == 0)
+			{
+				// drain the eventfd counter, pending sends are handled below
+				uint64_t counter = 0;
+				[[maybe_unused]] auto r = read(wakeFd, &counter, sizeof(counter));
+				continue;
+			}
+			serviceStream(key, events[i].events);
+		}
+
+		// streams which queued data to send
+		takePendingSends(sendKeys);
+		for (uint64_t key : sendKeys)
+			serviceStream(key, EPOLLOUT);
+
+		if (tickTimer.getElapsedMs() >= ES_EVENT_LOOP_TICK_MS)
+		{
+			expireStreamTimers();
+			tickTimer.start();
+		}
+	}
+}
+
+void EpollLoopThread::serviceStream(uint64_t key, uint32_t events)
+{
+	auto lock = Lock(streamsMutex);
+	StreamThread* stream = findStream(key);
+	if (not stream)
+		return; // stream was removed after the event was reported
+	if ((events & EPOLLERR) and not stream->usesZerocopy())
+	{
+		stream->closeFromEventLoop();
+		dropStream(key);
+		return;
+	}
+	if (not stream->pumpEvents())
+		dropStream(key);
+}
+
+#else // epoll is not available on this platform, agents fall back to one thread per connection
+
+bool EpollLoopThread::isSupported() { return false; }
+bool EpollLoopThread::start() { return false; }
+bool EpollLoopThread::registerSocket(uint64_t /*key*/, SOCKET /*s*/) { return false; }
+void EpollLoopThread::unregisterSocket(uint64_t /*key*/, SOCKET /*s*/) {}
+void EpollLoopThread::wake() {}
+void EpollLoopThread::threadMain() {}
+void EpollLoopThread::serviceStream(uint64_t /*key*/, uint32_t /*events*/) {}
+
+#endif
@@ -0,0 +1,27 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#pragma once
+#include "EventLoopThread.h"
+
+// event loop using edge-triggered epoll (Linux only), streams perform their own non-blocking I/O when ready
+class EpollLoopThread : public EventLoopThread
+{
+public:
+    EpollLoopThread() = default;
+    ~EpollLoopThread() override;
+
+    // returns false if epoll is not available on this platform
+    static bool isSupported();
+
+    bool start() override;
+
+protected:
+    bool registerSocket(uint64_t key, SOCKET s) override;
+    void unregisterSocket(uint64_t key, SOCKET s) override;
+    void wake() override;
+
+    void threadMain();
+    void serviceStream(uint64_t key, uint32_t events);
+
+    int epollFd = -1;
+    int wakeFd = -1; // eventfd, signalled when streams have queued data to send
+};
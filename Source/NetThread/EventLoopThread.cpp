@@ -0,0 +1,109 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#include "EventLoopThread.h"
+#include "StreamThread.h"
+#include "ThreadPlacement.h"
+#include "NetAgent/HttpServerUtils/Logging.h"
+#include <cassert>
+
+void EventLoopThread::setCore(int core_)
+{
+	assert(not thread.joinable() && "the core must be set before the loop is started");
+	core = core_;
+	numaNode = ThreadPlacement::numaNodeOfCore(core);
+}
+
+void EventLoopThread::applyPlacement()
+{
+	if (core < 0)
+		return;
+	if (not ThreadPlacement::pinCurrentThread(core))
+		ESLog::es_warning(ESLog::FormatStr() << "Event loop could not be pinned to core " << core);
+	// the streams' receive buffers grow on this thread, and the loop's own state is allocated here
+	if (numaNode >= 0)
+		ThreadPlacement::preferNumaNode(numaNode);
+}
+
+void EventLoopThread::join()
+{
+	stop();
+	if (thread.joinable())
+		thread.join();
+}
+
+uint64_t EventLoopThread::addStream(StreamThread* stream, SOCKET s)
+{
+	assert(stream and s != INVALID_SOCKET);
+	auto lock = Lock(streamsMutex);
+	const uint64_t key = ++streamKeyCounter;
+	RegisteredStream& registered = streams[key];
+	registered.stream = stream;
+	registered.socket = s;
+	if (not registerSocket(key, s))
+	{
+		ESLog::es_error("Failed to register socket with event loop");
+		streams.erase(key);
+		return 0;
+	}
+	registered.idleTimer.key = key;
+	double idleRemainingMs = 0.0;
+	stream->checkTimeouts(idleRemainingMs);
+	timers.arm(registered.idleTimer, idleRemainingMs);
+	return key;
+}
+
+void EventLoopThread::removeStream(uint64_t key)
+{
+	auto lock = Lock(streamsMutex); // waits for the stream to finish being serviced
+	dropStream(key);
+}
+
+void EventLoopThread::dropStream(uint64_t key)
+{
+	auto it = streams.find(key);
+	if (it == streams.end())
+		return;
+	unregisterSocket(key, it->second.socket);
+	streams.erase(it);
+}
+
+StreamThread* EventLoopThread::findStream(uint64_t key)
+{
+	auto it = streams.find(key);
+	return (it != streams.end()) ? it->second.stream : nullptr;
+}
+
+void EventLoopThread::notifySend(uint64_t key)
+{
+	{
+		auto lock = Lock(pendingSendsMutex);
+		pendingSends.push_back(key);
+	}
+	wake();
+}
+
+void EventLoopThread::takePendingSends(std::vector<uint64_t>& keysOut)
+{
+	keysOut.clear();
+	auto lock = Lock(pendingSendsMutex);
+	keysOut.swap(pendingSends);
+}
+
+size_t EventLoopThread::numStreams() const
+{
+	auto lock = Lock(streamsMutex);
+	return streams.size();
+}
+
+void EventLoopThread::expireStreamTimers()
+{
+	auto lock = Lock(streamsMutex);
+	timers.advance([this](WheelTimer& idleTimer)
+	{
+		const uint64_t key = idleTimer.key;
+		double idleRemainingMs = 0.0;
+		if (findStream(key)->checkTimeouts(idleRemainingMs))
+			timers.arm(idleTimer, idleRemainingMs); // communicated since the timer was armed
+		else
+			dropStream(key); // destroys the timer, which the wheel no longer references
+	});
+}
@@ -0,0 +1,80 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#pragma once
+#include "Sockets/Sockets.h"
+#include "NetThread/TimerWheel.h"
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+
+class StreamThread;
+
+// resolution of stream timeouts, the loop wakes at least this often to expire them (milliseconds)
+constexpr int ES_EVENT_LOOP_TICK_MS = 100;
+
+// services many non-blocking stream sockets from a single thread, the I/O mechanism is provided by derived classes
+// the thread only wakes when a socket has work to do, or when a stream has queued new data to send
+class EventLoopThread
+{
+public:
+    using Lock = Sockets::Lock; // syntactic sugar
+    EventLoopThread() = default;
+    virtual ~EventLoopThread() = default;
+    EventLoopThread(const EventLoopThread&) = delete;
+    EventLoopThread& operator=(const EventLoopThread&) = delete;
+
+    virtual bool start() = 0;
+    // pins the loop thread to the core once started, and has the memory it allocates placed on the core's NUMA node
+    // must be called before start, a negative core leaves placement to the OS
+    void setCore(int core);
+    int getCore() const { return core; }
+    int getNumaNode() const { return numaNode; } // node of the pinned core, -1 if not pinned or unknown
+    void stop() { forceTerminate = true; wake(); } // forces the event loop thread to shut down
+
+    // registers a connected socket, returns a key identifying the stream (0 on failure)
+    uint64_t addStream(StreamThread* stream, SOCKET s);
+    // unregisters a stream, blocks if the stream is currently being serviced, must be called before the stream is destroyed
+    void removeStream(uint64_t key);
+    // threadsafe, wakes the loop to send data that was queued on the stream
+    void notifySend(uint64_t key);
+
+    // lets the loop accept connections on a listen socket, returns false if the loop cannot accept on behalf of a listen thread
+    virtual bool addListener(SOCKET /*listenSocket*/, std::function<void(SOCKET)> /*onAccepted*/) { return false; }
+    virtual void removeListener(SOCKET /*listenSocket*/) {}
+
+    size_t numStreams() const;
+
+protected:
+    // the platform mechanism must stop watching the socket after unregisterSocket, streamsMutex is held for both calls
+    virtual bool registerSocket(uint64_t key, SOCKET s) = 0;
+    virtual void unregisterSocket(uint64_t key, SOCKET s) = 0;
+    virtual void wake() = 0;
+
+    void applyPlacement(); // called by the loop thread as it starts
+    // must be called by the derived destructor, before any resources used by the thread are released
+    void join();
+
+    StreamThread* findStream(uint64_t key); // streamsMutex must be held
+    void dropStream(uint64_t key); // streamsMutex must be held
+    // expires the timers which are due, a stream is only checked once its idle deadline has passed, which costs nothing for
+    // streams that keep communicating, their activity only moves the deadline, which is checked again once the timer expires
+    void expireStreamTimers();
+    void takePendingSends(std::vector<uint64_t>& keysOut);
+
+    std::thread thread{};
+    std::atomic<bool> forceTerminate = false;
+    int core = -1;
+    int numaNode = -1;
+
+    // registered streams, locked while a stream is being serviced
+    struct RegisteredStream { StreamThread* stream = nullptr; SOCKET socket = INVALID_SOCKET; WheelTimer idleTimer{}; };
+    std::unordered_map<uint64_t, RegisteredStream> streams;
+    mutable std::recursive_mutex streamsMutex;
+    TimerWheel timers{ ES_EVENT_LOOP_TICK_MS }; // deadlines of the registered streams, streamsMutex must be held
+    uint64_t streamKeyCounter = 0; // key 0 is never used for a stream
+
+    // streams which have queued data since the last wakeup
+    std::vector<uint64_t> pendingSends;
+    std::recursive_mutex pendingSendsMutex;
+};
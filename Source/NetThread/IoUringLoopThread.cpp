@@ -0,0 +1,649 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#include "IoUringLoopThread.h"
+#include "StreamThread.h"
+#include "ThreadPlacement.h"
+#include "NetAgent/HttpServerUtils/Logging.h"
+#include <cassert>
+#include <cstring>
+#include <atomic>
+#include <deque>
+
+#ifdef __linux__
+	#include <linux/io_uring.h>
+	#include <sys/syscall.h>
+	#include <sys/mman.h>
+	#include <sys/eventfd.h>
+	#include <cerrno>
+#endif
+
+constexpr unsigned ES_URING_ENTRIES = 1024;
+// receive buffers are lent to the kernel through a provided buffer ring, the count must be a power of two
+constexpr uint32_t ES_URING_RECV_BUFFER_COUNT = 512;
+constexpr uint32_t ES_URING_RECV_BUFFER_SIZE = 16384;
+constexpr uint16_t ES_URING_RECV_BUFFER_GROUP = 0;
+// send slots are preallocated, a stream holds one slot while its send is in flight
+constexpr uint32_t ES_URING_SEND_SLOT_COUNT = 256;
+constexpr uint32_t ES_URING_SEND_SLOT_SIZE = 65536;
+
+#ifdef __linux__
+
+namespace
+{
+	// the operation type is stored in the top byte of the user data, the rest holds the stream key or listen socket
+	enum class UringOp : uint64_t { Wake = 1, Timeout, Accept, Recv, Send, Cancel };
+	constexpr uint64_t ES_URING_ID_MASK = 0x00FFFFFFFFFFFFFF;
+	uint64_t makeUserData(UringOp op, uint64_t id) { return (static_cast<uint64_t>(op) << 56) | (id & ES_URING_ID_MASK); }
+
+	int sysSetup(unsigned entries, io_uring_params* params) { return (int)syscall(__NR_io_uring_setup, entries, params); }
+	int sysEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) { return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0); }
+	int sysRegister(int fd, unsigned opcode, const void* arg, unsigned numArgs) { return (int)syscall(__NR_io_uring_register, fd, opcode, arg, numArgs); }
+}
+
+struct IoUringResources
+{
+	int ringFd = -1;
+	int wakeFd = -1;
+
+	// submission and completion queues share one mapping (IORING_FEAT_SINGLE_MMAP)
+	void* ringMap = nullptr;
+	size_t ringMapSize = 0;
+	io_uring_sqe* sqes = nullptr;
+	size_t sqesSize = 0;
+	unsigned* sqHead = nullptr;
+	unsigned* sqTail = nullptr;
+	unsigned* sqArray = nullptr;
+	unsigned sqMask = 0;
+	unsigned sqEntries = 0;
+	unsigned sqLocalTail = 0; // entries up to here are prepared, but not necessarily published to the kernel
+	unsigned toSubmit = 0;
+	unsigned* cqHead = nullptr;
+	unsigned* cqTail = nullptr;
+	unsigned cqMask = 0;
+	io_uring_cqe* cqes = nullptr;
+
+	// provided buffer ring for multishot receive
+	io_uring_buf* recvRing = nullptr; // indexed directly, the flexible array in io_uring_buf_ring is offset when compiled as C++
+	size_t recvRingSize = 0;
+	std::unique_ptr<char[]> recvMemory = nullptr;
+	uint16_t recvRingTail = 0;
+
+	// send buffers, fixed buffers are not accepted by IORING_OP_SEND so these are plain memory owned by the loop
+	std::unique_ptr<char[]> sendMemory = nullptr;
+	std::vector<uint16_t> freeSendSlots{};
+	struct InFlightSend { uint16_t slot = 0; uint32_t offset = 0; uint32_t size = 0; };
+	std::unordered_map<uint64_t, InFlightSend> sends{};
+	std::deque<uint64_t> sendWaiters{}; // streams waiting for a free send slot
+	// streams not receiving until the application catches up, true once their multishot receive has ended
+	std::unordered_map<uint64_t, bool> pausedReceives{};
+
+	// operations requested by other threads, the loop thread submits them since the submission queue has a single producer
+	struct ControlOp { UringOp op; uint64_t id; SOCKET socket; };
+	std::vector<ControlOp> controlOps{};
+	std::recursive_mutex controlMutex{};
+
+	std::unordered_map<SOCKET, std::function<void(SOCKET)>> listeners{}; // guarded by the loop's streamsMutex
+
+	uint64_t wakeCounter = 0;
+	__kernel_timespec tick{};
+	bool timeoutArmed = false;
+
+	~IoUringResources();
+	bool init();
+	io_uring_sqe* getSqe(uint64_t userData);
+	int submit(unsigned minComplete);
+	void recycleRecvBuffer(uint16_t bufferId);
+	char* getRecvBuffer(uint16_t bufferId) { return recvMemory.get() + size_t(bufferId) * ES_URING_RECV_BUFFER_SIZE; }
+	char* getSendSlot(uint16_t slot) { return sendMemory.get() + size_t(slot) * ES_URING_SEND_SLOT_SIZE; }
+
+	void prepWake();
+	void prepTimeout();
+	void prepAccept(SOCKET listenSocket);
+	void prepRecv(uint64_t key, SOCKET s);
+	void prepSend(uint64_t key, SOCKET s, const InFlightSend& send);
+	void prepCancel(uint64_t targetUserData);
+	void pushControlOp(UringOp op, uint64_t id, SOCKET s);
+};
+
+IoUringResources::~IoUringResources()
+{
+	if (recvRing)
+		munmap(recvRing, recvRingSize);
+	if (sqes)
+		munmap(sqes, sqesSize);
+	if (ringMap)
+		munmap(ringMap, ringMapSize);
+	if (ringFd != -1)
+		close(ringFd);
+	if (wakeFd != -1)
+		close(wakeFd);
+}
+
+bool IoUringResources::init()
+{
+	io_uring_params params{};
+	params.flags = IORING_SETUP_COOP_TASKRUN; // completions are only reaped by the loop thread, no need to interrupt it
+	ringFd = sysSetup(ES_URING_ENTRIES, &params);
+	if (ringFd < 0 and errno == EINVAL)
+	{
+		params = io_uring_params{};
+		ringFd = sysSetup(ES_URING_ENTRIES, &params);
+	}
+	if (ringFd < 0 or not (params.features & IORING_FEAT_SINGLE_MMAP))
+		return false;
+
+	ringMapSize = ESMax(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+						params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+	ringMap = mmap(nullptr, ringMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+	sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+	void* sqesMap = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+	if (ringMap == MAP_FAILED or sqesMap == MAP_FAILED)
+	{
+		ringMap = (ringMap == MAP_FAILED) ? nullptr : ringMap;
+		sqes = (sqesMap == MAP_FAILED) ? nullptr : static_cast<io_uring_sqe*>(sqesMap);
+		return false;
+	}
+	sqes = static_cast<io_uring_sqe*>(sqesMap);
+	char* ring = static_cast<char*>(ringMap);
+	sqHead = reinterpret_cast<unsigned*>(ring + params.sq_off.head);
+	sqTail = reinterpret_cast<unsigned*>(ring + params.sq_off.tail);
+	sqArray = reinterpret_cast<unsigned*>(ring + params.sq_off.array);
+	sqMask = *reinterpret_cast<unsigned*>(ring + params.sq_off.ring_mask);
+	sqEntries = *reinterpret_cast<unsigned*>(ring + params.sq_off.ring_entries);
+	sqLocalTail = *sqTail;
+	cqHead = reinterpret_cast<unsigned*>(ring + params.cq_off.head);
+	cqTail = reinterpret_cast<unsigned*>(ring + params.cq_off.tail);
+	cqMask = *reinterpret_cast<unsigned*>(ring + params.cq_off.ring_mask);
+	cqes = reinterpret_cast<io_uring_cqe*>(ring + params.cq_off.cqes);
+
+	// lend the receive buffers to the kernel, multishot receives pick a buffer from the ring for each completion
+	recvRingSize = ES_URING_RECV_BUFFER_COUNT * sizeof(io_uring_buf);
+	void* recvRingMap = mmap(nullptr, recvRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (recvRingMap == MAP_FAILED)
+		return false;
+	recvRing = static_cast<io_uring_buf*>(recvRingMap);
+	recvMemory = std::unique_ptr<char[]>(new char[size_t(ES_URING_RECV_BUFFER_COUNT) * ES_URING_RECV_BUFFER_SIZE]);
+	io_uring_buf_reg bufferRegistration{};
+	bufferRegistration.ring_addr = reinterpret_cast<uint64_t>(recvRing);
+	bufferRegistration.ring_entries = ES_URING_RECV_BUFFER_COUNT;
+	bufferRegistration.bgid = ES_URING_RECV_BUFFER_GROUP;
+	if (sysRegister(ringFd, IORING_REGISTER_PBUF_RING, &bufferRegistration, 1) != 0)
+		return false;
+	for (uint32_t i = 0; i < ES_URING_RECV_BUFFER_COUNT; i++)
+		recycleRecvBuffer(static_cast<uint16_t>(i));
+
+	sendMemory = std::unique_ptr<char[]>(new char[size_t(ES_URING_SEND_SLOT_COUNT) * ES_URING_SEND_SLOT_SIZE]);
+	for (uint32_t i = 0; i < ES_URING_SEND_SLOT_COUNT; i++)
+		freeSendSlots.push_back(static_cast<uint16_t>(ES_URING_SEND_SLOT_COUNT - 1 - i));
+
+	wakeFd = eventfd(0, EFD_CLOEXEC);
+	tick.tv_sec = ES_EVENT_LOOP_TICK_MS / 1000;
+	tick.tv_nsec = (ES_EVENT_LOOP_TICK_MS % 1000) * 1000000LL;
+	return wakeFd != -1;
+}
+
+io_uring_sqe* IoUringResources::getSqe(uint64_t userData)
+{
+	if (sqLocalTail - std::atomic_ref<unsigned>(*sqHead).load(std::memory_order_acquire) >= sqEntries)
+	{
+		submit(0); // queue is full, hand the prepared entries to the kernel first
+		if (sqLocalTail - std::atomic_ref<unsigned>(*sqHead).load(std::memory_order_acquire) >= sqEntries)
+		{
+			ESLog::es_error("io_uring submission queue overflow");
+			return nullptr;
+		}
+	}
+	const unsigned index = sqLocalTail & sqMask;
+	io_uring_sqe* sqe = &sqes[index];
+	memset(sqe, 0, sizeof(io_uring_sqe));
+	sqe->user_data = userData;
+	sqArray[index] = index;
+	sqLocalTail++;
+	toSubmit++;
+	return sqe;
+}
+
+int IoUringResources::submit(unsigned minComplete)
+{
+	std::atomic_ref<unsigned>(*sqTail).store(sqLocalTail, std::memory_order_release);
+	const int submitted = sysEnter(ringFd, toSubmit, minComplete, (minComplete > 0) ? IORING_ENTER_GETEVENTS : 0);
+	if (submitted > 0)
+		toSubmit -= ESMin((unsigned)submitted, toSubmit);
+	return submitted;
+}
+
+void IoUringResources::recycleRecvBuffer(uint16_t bufferId)
+{
+	// only the descriptor fields are written, the ring tail overlays the reserved field of the first entry
+	io_uring_buf& buffer = recvRing[recvRingTail & (ES_URING_RECV_BUFFER_COUNT - 1)];
+	buffer.addr = reinterpret_cast<uint64_t>(getRecvBuffer(bufferId));
+	buffer.len = ES_URING_RECV_BUFFER_SIZE;
+	buffer.bid = bufferId;
+	recvRingTail++;
+	std::atomic_ref<uint16_t>(recvRing[0].resv).store(recvRingTail, std::memory_order_release);
+}
+
+void IoUringResources::prepWake()
+{
+	if (auto* sqe = getSqe(makeUserData(UringOp::Wake, 0)))
+	{
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = wakeFd;
+		sqe->addr = reinterpret_cast<uint64_t>(&wakeCounter);
+		sqe->len = sizeof(wakeCounter);
+	}
+}
+
+void IoUringResources::prepTimeout()
+{
+	if (auto* sqe = getSqe(makeUserData(UringOp::Timeout, 0)))
+	{
+		sqe->opcode = IORING_OP_TIMEOUT;
+		sqe->addr = reinterpret_cast<uint64_t>(&tick);
+		sqe->len = 1;
+		timeoutArmed = true;
+	}
+}
+
+void IoUringResources::prepAccept(SOCKET listenSocket)
+{
+	if (auto* sqe = getSqe(makeUserData(UringOp::Accept, static_cast<uint64_t>(listenSocket))))
+	{
+		sqe->opcode = IORING_OP_ACCEPT;
+		sqe->fd = listenSocket;
+		sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+		sqe->accept_flags = SOCK_CLOEXEC;
+	}
+}
+
+void IoUringResources::prepRecv(uint64_t key, SOCKET s)
+{
+	if (auto* sqe = getSqe(makeUserData(UringOp::Recv, key)))
+	{
+		sqe->opcode = IORING_OP_RECV;
+		sqe->fd = s;
+		sqe->flags = IOSQE_BUFFER_SELECT;
+		sqe->buf_group = ES_URING_RECV_BUFFER_GROUP;
+		sqe->ioprio = IORING_RECV_MULTISHOT;
+	}
+}
+
+void IoUringResources::prepSend(uint64_t key, SOCKET s, const InFlightSend& send)
+{
+	if (auto* sqe = getSqe(makeUserData(UringOp::Send, key)))
+	{
+		sqe->opcode = IORING_OP_SEND;
+		sqe->fd = s;
+		sqe->addr = reinterpret_cast<uint64_t>(getSendSlot(send.slot) + send.offset);
+		sqe->len = send.size - send.offset;
+		sqe->msg_flags = MSG_NOSIGNAL;
+	}
+}
+
+void IoUringResources::prepCancel(uint64_t targetUserData)
+{
+	if (auto* sqe = getSqe(makeUserData(UringOp::Cancel, 0)))
+	{
+		sqe->opcode = IORING_OP_ASYNC_CANCEL;
+		sqe->addr = targetUserData;
+	}
+}
+
+void IoUringResources::pushControlOp(UringOp op, uint64_t id, SOCKET s)
+{
+	auto lock = Sockets::Lock(controlMutex);
+	controlOps.push_back(ControlOp{ .op = op, .id = id, .socket = s });
+}
+
+IoUringLoopThread::IoUringLoopThread()
+	: resources{ std::make_unique<IoUringResources>() }
+{
+}
+
+IoUringLoopThread::~IoUringLoopThread()
+{
+	join();
+}
+
+bool IoUringLoopThread::isSupported()
+{
+	io_uring_params params{};
+	const int fd = sysSetup(1, &params);
+	if (fd < 0)
+		return false;
+	close(fd);
+	return true;
+}
+
+bool IoUringLoopThread::start()
+{
+	// the rings are shared with the kernel for the life of the loop, they belong on the node of the core servicing them
+	bool initialized = false;
+	{
+		ThreadPlacement::ScopedNumaPreference preference{ numaNode };
+		initialized = resources->init();
+	}
+	if (not initialized)
+	{
+		ESLog::es_error("io_uring could not be initialized");
+		return false;
+	}
+	thread = std::thread([this] { this->threadMain(); }); // create thread
+	return true;
+}
+
+bool IoUringLoopThread::registerSocket(uint64_t key, SOCKET s)
+{
+	resources->pushControlOp(UringOp::Recv, key, s);
+	wake();
+	return true;
+}
+
+void IoUringLoopThread::unregisterSocket(uint64_t key, SOCKET s)
+{
+	resources->pausedReceives.erase(key);
+	// closing the socket does not end operations that are in flight, they must be cancelled
+	resources->pushControlOp(UringOp::Cancel, makeUserData(UringOp::Recv, key), s);
+	resources->pushControlOp(UringOp::Cancel, makeUserData(UringOp::Send, key), s);
+	wake();
+}
+
+bool IoUringLoopThread::addListener(SOCKET listenSocket, std::function<void(SOCKET)> onAccepted)
+{
+	{
+		auto lock = Lock(streamsMutex);
+		resources->listeners[listenSocket] = onAccepted;
+	}
+	resources->pushControlOp(UringOp::Accept, 0, listenSocket);
+	wake();
+	return true;
+}
+
+void IoUringLoopThread::removeListener(SOCKET listenSocket)
+{
+	{
+		auto lock = Lock(streamsMutex);
+		resources->listeners.erase(listenSocket);
+	}
+	resources->pushControlOp(UringOp::Cancel, makeUserData(UringOp::Accept, static_cast<uint64_t>(listenSocket)), listenSocket);
+	wake();
+}
+
+void IoUringLoopThread::wake()
+{
+	if (resources->wakeFd == -1)
+		return;
+	const uint64_t one = 1;
+	[[maybe_unused]] auto r = write(resources->wakeFd, &one, sizeof(one));
+}
+
+void IoUringLoopThread::threadMain()
+{
+	WIN_SET_THREAD_NAME(L"io_uring Loop Thread");
+	applyPlacement();
+	auto& r = *resources;
+	std::vector<uint64_t> sendKeys;
+	Timer tickTimer;
+	tickTimer.start();
+	r.prepWake();
+
+	while (!forceTerminate)
+	{
+		submitControlOps();
+
+		// streams which queued data to send
+		takePendingSends(sendKeys);
+		if (not sendKeys.empty())
+		{
+			auto lock = Lock(streamsMutex);
+			for (uint64_t key : sendKeys)
+				trySend(key);
+		}
+
+		if (not r.timeoutArmed)
+			r.prepTimeout();
+
+		// submits everything prepared since the last iteration, and waits for at least one completion
+		if (r.submit(1) < 0 and errno != EINTR and errno != EBUSY)
+		{
+			ESLog::es_error("io_uring loop terminating: io_uring_enter failed");
+			break;
+		}
+
+		auto lock = Lock(streamsMutex);
+		unsigned head = *r.cqHead;
+		const unsigned tail = std::atomic_ref<unsigned>(*r.cqTail).load(std::memory_order_acquire);
+		while (head != tail)
+		{
+			const io_uring_cqe cqe = r.cqes[head & r.cqMask];
+			head++;
+			std::atomic_ref<unsigned>(*r.cqHead).store(head, std::memory_order_release);
+			handleCompletion(cqe.user_data, cqe.res, cqe.flags);
+		}
+
+		if (tickTimer.getElapsedMs() >= ES_EVENT_LOOP_TICK_MS)
+		{
+			expireStreamTimers();
+			tickTimer.start();
+		}
+	}
+}
+
+void IoUringLoopThread::submitControlOps()
+{
+	auto& r = *resources;
+	std::vector<IoUringResources::ControlOp> ops;
+	{
+		auto lock = Lock(r.controlMutex);
+		ops.swap(r.controlOps);
+	}
+	if (ops.empty())
+		return;
+
+	// streams and listeners cannot be removed (and their sockets closed) until the operations have been submitted
+	auto lock = Lock(streamsMutex);
+	for (const auto& op : ops)
+	{
+		if (op.op == UringOp::Recv and findStream(op.id))
+			r.prepRecv(op.id, op.socket);
+		else if (op.op == UringOp::Accept and r.listeners.contains(op.socket))
+			r.prepAccept(op.socket);
+		else if (op.op == UringOp::Cancel)
+			r.prepCancel(op.id);
+	}
+	r.submit(0);
+}
+
+void IoUringLoopThread::handleCompletion(uint64_t userData, int32_t result, uint32_t flags)
+{
+	auto& r = *resources;
+	const auto op = static_cast<UringOp>(userData >> 56);
+	const uint64_t id = userData & ES_URING_ID_MASK;
+	if (op == UringOp::Wake)
+	{
+		r.prepWake();
+	}
+	else if (op == UringOp::Timeout)
+	{
+		r.timeoutArmed = false;
+	}
+	else if (op == UringOp::Accept)
+	{
+		const SOCKET listenSocket = static_cast<SOCKET>(id);
+		auto it = r.listeners.find(listenSocket);
+		if (result >= 0)
+		{
+			if (it != r.listeners.end())
+				it->second(static_cast<SOCKET>(result));
+			else
+				Sockets::closeSocket(static_cast<SOCKET>(result));
+		}
+		if (it != r.listeners.end() and not (flags & IORING_CQE_F_MORE))
+			r.prepAccept(listenSocket); // multishot accept ended, rearm
+	}
+	else if (op == UringOp::Recv)
+	{
+		handleReceived(id, result, flags);
+	}
+	else if (op == UringOp::Send)
+	{
+		handleSent(id, result);
+	}
+}
+
+void IoUringLoopThread::handleReceived(uint64_t key, int32_t result, uint32_t flags)
+{
+	auto& r = *resources;
+	StreamThread* stream = findStream(key);
+	const bool hasBuffer = (flags & IORING_CQE_F_BUFFER);
+	const uint16_t bufferId = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+	bool alive = (stream != nullptr);
+	if (alive and hasBuffer and result > 0)
+		alive = stream->loopDeliverReceived(r.getRecvBuffer(bufferId), static_cast<size_t>(result));
+	if (hasBuffer)
+		r.recycleRecvBuffer(bufferId);
+	if (not stream)
+		return; // completion for a stream which was already removed
+
+	const bool multishotEnded = not (flags & IORING_CQE_F_MORE);
+	auto paused = r.pausedReceives.find(key);
+	const bool cancelledByPause = (paused != r.pausedReceives.end() and result == -ECANCELED);
+	if (not alive or result == 0 or (result < 0 and result != -ENOBUFS and not cancelledByPause))
+	{
+		// zero means orderly shutdown by the peer
+		if (alive)
+			stream->closeFromEventLoop();
+		closeStream(key);
+		return;
+	}
+	if (paused != r.pausedReceives.end())
+	{
+		if (multishotEnded)
+			paused->second = true; // resumed from trySend
+	}
+	else if (not stream->receiveAllowed())
+	{
+		// the application is falling behind, received data waits in the kernel until it catches up
+		r.pausedReceives[key] = multishotEnded;
+		if (not multishotEnded)
+		{
+			r.prepCancel(makeUserData(UringOp::Recv, key));
+			r.submit(0); // right away, completions keep arriving until the cancel takes effect
+		}
+	}
+	else if (multishotEnded)
+		r.prepRecv(key, streams[key].socket); // multishot receive ended (for example when buffers ran out), rearm
+
+	// receiving may have produced data to send, such as TLS handshake records
+	trySend(key);
+}
+
+void IoUringLoopThread::handleSent(uint64_t key, int32_t result)
+{
+	auto& r = *resources;
+	auto it = r.sends.find(key);
+	if (it == r.sends.end())
+		return;
+	auto& send = it->second;
+	StreamThread* stream = findStream(key);
+	if (result > 0 and stream)
+	{
+		send.offset += static_cast<uint32_t>(result);
+		if (send.offset < send.size)
+		{
+			r.prepSend(key, streams[key].socket, send); // partial send, continue from the same slot
+			return;
+		}
+		stream->loopSendCompleted();
+	}
+
+	r.freeSendSlots.push_back(send.slot);
+	r.sends.erase(it);
+	if (stream and result <= 0)
+	{
+		if (result != -ECANCELED)
+			stream->closeFromEventLoop();
+		closeStream(key);
+	}
+	else if (stream)
+	{
+		trySend(key);
+	}
+
+	// another stream may have been waiting for the slot
+	while (not r.freeSendSlots.empty() and not r.sendWaiters.empty())
+	{
+		const uint64_t waiting = r.sendWaiters.front();
+		r.sendWaiters.pop_front();
+		trySend(waiting);
+	}
+}
+
+// streamsMutex must be held
+void IoUringLoopThread::trySend(uint64_t key)
+{
+	auto& r = *resources;
+	// the application taking received data wakes the loop through the same path, a paused receive may resume
+	auto paused = r.pausedReceives.find(key);
+	if (paused != r.pausedReceives.end() and paused->second)
+	{
+		auto it = streams.find(key);
+		if (it != streams.end() and it->second.stream->receiveAllowed())
+		{
+			r.pausedReceives.erase(paused);
+			r.prepRecv(key, it->second.socket);
+		}
+	}
+	if (r.sends.contains(key))
+		return; // sending continues when the current send completes
+	auto it = streams.find(key);
+	if (it == streams.end())
+		return;
+	if (not it->second.stream->checkRunning())
+	{
+		closeStream(key); // stopped, the event loop was woken to drop it
+		return;
+	}
+
+	if (r.freeSendSlots.empty())
+	{
+		r.sendWaiters.push_back(key);
+		return;
+	}
+
+	const uint16_t slot = r.freeSendSlots.back();
+	const size_t size = it->second.stream->loopTakeOutgoing(r.getSendSlot(slot), ES_URING_SEND_SLOT_SIZE);
+	if (size == 0)
+		return;
+	r.freeSendSlots.pop_back();
+	auto& send = r.sends[key];
+	send = IoUringResources::InFlightSend{ .slot = slot, .offset = 0, .size = static_cast<uint32_t>(size) };
+	r.prepSend(key, it->second.socket, send);
+}
+
+// streamsMutex must be held
+void IoUringLoopThread::closeStream(uint64_t key)
+{
+	dropStream(key);
+}
+
+#else // io_uring is not available on this platform
+
+struct IoUringResources {};
+IoUringLoopThread::IoUringLoopThread() = default;
+IoUringLoopThread::~IoUringLoopThread() { join(); }
+bool IoUringLoopThread::isSupported() { return false; }
+bool IoUringLoopThread::start() { return false; }
+bool IoUringLoopThread::addListener(SOCKET /*listenSocket*/, std::function<void(SOCKET)> /*onAccepted*/) { return false; }
+void IoUringLoopThread::removeListener(SOCKET /*listenSocket*/) {}
+bool IoUringLoopThread::registerSocket(uint64_t /*key*/, SOCKET /*s*/) { return false; }
+void IoUringLoopThread::unregisterSocket(uint64_t /*key*/, SOCKET /*s*/) {}
+void IoUringLoopThread::wake() {}
+void IoUringLoopThread::threadMain() {}
+void IoUringLoopThread::submitControlOps() {}
+void IoUringLoopThread::handleCompletion(uint64_t /*userData*/, int32_t /*result*/, uint32_t /*flags*/) {}
+void IoUringLoopThread::handleReceived(uint64_t /*key*/, int32_t /*result*/, uint32_t /*flags*/) {}
+void IoUringLoopThread::handleSent(uint64_t /*key*/, int32_t /*result*/) {}
+void IoUringLoopThread::trySend(uint64_t /*key*/) {}
+void IoUringLoopThread::closeStream(uint64_t /*key*/) {}
+
+#endif
@@ -0,0 +1,40 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#pragma once
+#include "EventLoopThread.h"
+#include <memory>
+
+struct IoUringResources;
+
+// event loop using io_uring (Linux only), accept, receive and send operations for all streams complete through one ring
+// receives use multishot recv into a provided buffer ring registered with the kernel, sends are copied into preallocated slots
+class IoUringLoopThread : public EventLoopThread
+{
+public:
+    IoUringLoopThread();
+    ~IoUringLoopThread() override;
+
+    // returns false if the kernel does not provide the io_uring features used here
+    static bool isSupported();
+
+    bool start() override;
+
+    bool addListener(SOCKET listenSocket, std::function<void(SOCKET)> onAccepted) override;
+    void removeListener(SOCKET listenSocket) override;
+
+protected:
+    bool registerSocket(uint64_t key, SOCKET s) override;
+    void unregisterSocket(uint64_t key, SOCKET s) override;
+    void wake() override;
+
+    void threadMain();
+    void submitControlOps();
+    void handleCompletion(uint64_t userData, int32_t result, uint32_t flags);
+    void handleReceived(uint64_t key, int32_t result, uint32_t flags);
+    void handleSent(uint64_t key, int32_t result);
+    void trySend(uint64_t key);
+    void closeStream(uint64_t key);
+
+private:
+    // the ring and its memory mappings are encapsulated to keep the kernel types in the translation unit
+    std::unique_ptr<IoUringResources> resources;
+};
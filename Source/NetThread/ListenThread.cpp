@@ -1,70 +1,267 @@
 // Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
 #include "ListenThread.h"
 #include "StreamThread.h"
+#include "EventLoopThread.h"
+#include "ThreadPlacement.h"
+#include "NetAgent/Agent.h"
 #include "NetAgent/HttpServerUtils/Logging.h"
 #include <cassert>
 #include <thread>
 #include <chrono>
 
+#ifdef __linux__
+	#include <sys/eventfd.h>
+#endif
+#ifndef _WIN32
+	#include <poll.h>
+#endif
+
+// maximum number of connections accepted before the queue is handed over and the stop flag is checked again
+constexpr size_t ES_ACCEPT_BATCH_SIZE = 64;
+// upper bound for waiting on the listen socket, only matters where the thread cannot be woken through an eventfd (milliseconds)
+constexpr int ES_LISTEN_POLL_MAX_MS = 100;
+
+ListenThread::ListenThread()
+{
+#ifdef __linux__
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    readyFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+}
+
 ListenThread::~ListenThread() 
 { 
     stop();
-    thread.join();
+    if (thread.joinable())
+        thread.join();
+
+    // close connections that were never handed over
+    SOCKET s = INVALID_SOCKET;
+    while (connSockets.pop(s))
+        Sockets::closeSocket(s);
+#ifdef __linux__
+    if (wakeFd != -1)
+        close(wakeFd);
+    if (readyFd != -1)
+        close(readyFd);
+#endif
 }
 
-void ListenThread::start(std::string_view port, std::string_view hostname)
+void ListenThread::start(std::string_view port, std::string_view hostname, EventLoopThread* acceptLoop_, bool reusePort_, int core_)
 {
     listenPort = port;
 	selfHostname = hostname;
-    assert(!listenPort.empty() && "valid port number must be provided for listen socket");
+    acceptLoop = acceptLoop_;
+    reusePort = reusePort_;
+    core = core_;
+    if (not settings)
+        settings = std::make_shared<NetAgentSettings>();
+    assert((!listenPort.empty() or Sockets::isUnixAddress(selfHostname)) && "valid port number must be provided for listen socket");
     thread = std::thread([this] { this->threadMain(); }); // create thread
 }
 
 void ListenThread::threadMain()
 {
 	WIN_SET_THREAD_NAME(L"Listen Thread");
+    if (core >= 0 and not ThreadPlacement::pinCurrentThread(core))
+        ESLog::es_warning(ESLog::FormatStr() << "Listen thread could not be pinned to core " << core);
     SOCKET listenSocket = INVALID_SOCKET;
-    forceTerminate = !Sockets::createListenSocket(listenSocket, listenPort, selfHostname);
+    Sockets::SocketTuningReport tuningReport{};
+    forceTerminate = !Sockets::createListenSocket(listenSocket, listenPort, selfHostname, settings->listenBacklog, reusePort,
+                                                  settings->socketTuning, &tuningReport);
+    if (forceTerminate)
+        ESLog::es_error(ESLog::FormatStr() << "Failed to create listen socket on " << getListenName());
+    else if (not settings->socketTuning.isDefault())
+    {
+        ESLog::es_info(ESLog::FormatStr() << "Listen socket options on " << getListenName() << ": " << tuningReport.toString());
+        std::lock_guard<std::mutex> lock(tuningMutex);
+        listenTuningReport = std::move(tuningReport);
+    }
+    if (!forceTerminate and settings->steerToIncomingCpu and core >= 0 and not Sockets::isUnixAddress(selfHostname) and
+        not Sockets::setIncomingCpu(listenSocket, core))
+        ESLog::es_warning(ESLog::FormatStr() << "Connections arriving on core " << core << " cannot be steered to " << getListenName());
+
+    // completion based event loops accept connections themselves, the listen thread only owns the socket
+    if (!forceTerminate and acceptLoop and acceptLoop->addListener(listenSocket, [this](SOCKET s) { addConnectedSocket(s); }))
+    {
+        while (!forceTerminate)
+            waitForActivity(INVALID_SOCKET, ES_LISTEN_POLL_MAX_MS);
+        acceptLoop->removeListener(listenSocket);
+        Sockets::closeSocket(listenSocket);
+        Sockets::removeUnixSocketFile(selfHostname);
+        return;
+    }
+
+    // the listen socket never blocks, the thread waits for readiness instead so it can be stopped at any time
+    if (!forceTerminate)
+        Sockets::setBlocking(listenSocket, false);
 	
     // listener loop
     while (!forceTerminate)
     {
-        SOCKET s = accept(listenSocket, nullptr, nullptr); // try to accept a connection
-        if (s != INVALID_SOCKET)
-		{
-			ESLog::es_detail("New connection established");
-			addConnectedSocket(s);
-		}
-
-		if (getNumNewlyConnected() >= 10)
-		{
-			// temporarily stop accepting connections if there are too many requests to connect
-			ESLog::es_detail(ESLog::FormatStr() << getNumNewlyConnected() << " pending new connections, slowing down acceptance rate");
-			while (getNumNewlyConnected() >= 10)
-				Sockets::threadSleep(80);
-		}
+        if (numPendingSockets >= settings->concurrentConnectRequestsMax)
+        {
+            // temporarily stop accepting connections if there are too many requests to connect, they wait in the kernel backlog
+            if (not overloaded.exchange(true))
+                ESLog::es_detail(ESLog::FormatStr() << numPendingSockets.load() << " pending new connections, slowing down acceptance rate");
+            waitForActivity(INVALID_SOCKET, (int)settings->connectRequestOverloadDelayMs);
+            continue;
+        }
+        overloaded = false;
+
+        acceptBatch(listenSocket);
+        if (numPendingSockets < settings->concurrentConnectRequestsMax)
+            waitForActivity(listenSocket, ES_LISTEN_POLL_MAX_MS);
     }
     Sockets::closeSocket(listenSocket);
+    Sockets::removeUnixSocketFile(selfHostname);
 }
 
-void ListenThread::addConnectedSocket(SOCKET s) 
+void ListenThread::acceptBatch(SOCKET listenSocket)
 {
-    auto lock = Lock(connSocketsMutex);
-    connSockets.push_back(s);
+    size_t numAccepted = 0;
+    while (numAccepted < ES_ACCEPT_BATCH_SIZE and numPendingSockets < settings->concurrentConnectRequestsMax)
+    {
+        SOCKET s = Sockets::acceptConnection(listenSocket);
+        if (s == INVALID_SOCKET)
+        {
+            // out of descriptors or memory, the socket stays readable so back off instead of spinning
+            if (not Sockets::lastErrorWouldBlock())
+                waitForActivity(INVALID_SOCKET, (int)settings->connectRequestOverloadDelayMs);
+            break; // backlog drained
+        }
+        tuneAcceptedSocket(s);
+        connSockets.push(s);
+        numPendingSockets++;
+        numAccepted++;
+    }
+    if (numAccepted > 0)
+    {
+        ESLog::es_detail(ESLog::FormatStr() << numAccepted << " new connections established");
+        notifyReady();
+    }
 }
 
-size_t ListenThread::getNumNewlyConnected()
+void ListenThread::waitForActivity(SOCKET listenSocket, int timeoutMs)
 {
-	auto lock = Lock(connSocketsMutex);
-	return connSockets.size();
+#ifdef _WIN32
+    if (listenSocket == INVALID_SOCKET)
+    {
+        Sockets::threadSleep(ESMin(timeoutMs, ES_LISTEN_POLL_MAX_MS));
+        return;
+    }
+    WSAPOLLFD fd{};
+    fd.fd = listenSocket;
+    fd.events = POLLRDNORM;
+    WSAPoll(&fd, 1, ESMin(timeoutMs, ES_LISTEN_POLL_MAX_MS));
+#else
+    pollfd fds[2]{};
+    nfds_t numFds = 0;
+    if (wakeFd != -1)
+        fds[numFds++] = pollfd{ .fd = wakeFd, .events = POLLIN, .revents = 0 };
+    if (listenSocket != INVALID_SOCKET)
+        fds[numFds++] = pollfd{ .fd = listenSocket, .events = POLLIN, .revents = 0 };
+    poll(fds, numFds, (wakeFd != -1) ? timeoutMs : ESMin(timeoutMs, ES_LISTEN_POLL_MAX_MS));
+    #ifdef __linux__
+    if (wakeFd != -1 and (fds[0].revents & POLLIN))
+    {
+        uint64_t counter = 0;
+        [[maybe_unused]] auto r = read(wakeFd, &counter, sizeof(counter));
+    }
+    #endif
+#endif
+}
+
+void ListenThread::wake()
+{
+#ifdef __linux__
+    if (wakeFd == -1)
+        return;
+    const uint64_t one = 1;
+    [[maybe_unused]] auto r = write(wakeFd, &one, sizeof(one));
+#endif
+}
+
+void ListenThread::notifyReady()
+{
+    {
+        std::lock_guard<std::mutex> lock(readyCallbackMutex);
+        if (readyCallback)
+            readyCallback();
+    }
+#ifdef __linux__
+    if (readyFd == -1)
+        return;
+    const uint64_t one = 1;
+    [[maybe_unused]] auto r = write(readyFd, &one, sizeof(one));
+#endif
+}
+
+void ListenThread::setReadyCallback(std::function<void()> callback)
+{
+    std::lock_guard<std::mutex> lock(readyCallbackMutex);
+    readyCallback = std::move(callback);
+}
+
+void ListenThread::tuneAcceptedSocket(SOCKET s)
+{
+    const Sockets::SocketTuning& tuning = settings->socketTuning;
+    if (tuning.isDefault())
+        return;
+    // where accepted sockets inherit the options of the listen socket, the first one is only read back to confirm it
+    const bool inherited = Sockets::socketTuningInherited() and not Sockets::isUnixAddress(selfHostname);
+    if (inherited and acceptedTuningChecked)
+        return;
+    Sockets::SocketTuningReport report = inherited ? Sockets::readSocketTuning(s, tuning, Sockets::SocketRole::Accepted)
+                                                   : Sockets::applySocketTuning(s, tuning, Sockets::SocketRole::Accepted);
+    if (acceptedTuningChecked.exchange(true))
+        return;
+    ESLog::es_info(ESLog::FormatStr() << "Accepted socket options on " << getListenName() << ": " << report.toString());
+    std::lock_guard<std::mutex> lock(tuningMutex);
+    acceptedTuningReport = std::move(report);
+}
+
+std::string ListenThread::getListenName() const
+{
+    return Sockets::isUnixAddress(selfHostname) ? selfHostname : "port " + listenPort;
+}
+
+std::string ListenThread::getTuningReport() const
+{
+    std::lock_guard<std::mutex> lock(tuningMutex);
+    return "listen: " + listenTuningReport.toString() + ", accepted: " + acceptedTuningReport.toString();
+}
+
+void ListenThread::updateSettings(const std::shared_ptr<NetAgentSettings>& settingsNew)
+{
+    settings = settingsNew;
+}
+
+void ListenThread::addConnectedSocket(SOCKET s) 
+{
+    tuneAcceptedSocket(s);
+    connSockets.push(s);
+    numPendingSockets++;
+    notifyReady();
 }
 
 std::vector<SOCKET> ListenThread::getConnectedSockets()
 {
-    auto lock = Lock(connSocketsMutex, std::try_to_lock);
-    if (!lock.owns_lock() || connSockets.empty()) { return std::vector<SOCKET>(); }
+#ifdef __linux__
+    if (readyFd != -1)
+    {
+        uint64_t counter = 0;
+        [[maybe_unused]] auto r = read(readyFd, &counter, sizeof(counter)); // reset before draining, so no notification is lost
+    }
+#endif
+    std::vector<SOCKET> outSockets;
+    SOCKET s = INVALID_SOCKET;
+    while (connSockets.pop(s))
+        outSockets.push_back(s);
+    numPendingSockets -= outSockets.size();
 
-    std::vector<SOCKET> outSockets = connSockets;
-    connSockets.clear();
+    // resume accepting right away instead of waiting out the overload delay
+    if (not outSockets.empty() and overloaded)
+        wake();
     return outSockets;
 }
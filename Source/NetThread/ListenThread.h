@@ -1,33 +1,78 @@
 // Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
 #pragma once
 #include "Sockets/Sockets.h"
+#include "NetThread/MpscQueue.h"
 #include <thread>
 #include <vector>
 #include <string>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <functional>
+
+class EventLoopThread;
+class NetAgentSettings;
 
 // TCP server connection listener op thread class
 class ListenThread
 {
 public:
     using Lock = Sockets::Lock; // syntactic sugar
-    ListenThread() = default;
+    ListenThread();
     ~ListenThread();
 
-    void start(std::string_view port, std::string_view hostname);
+    // if acceptLoop is provided and able to accept on behalf of the listen thread, connections are accepted by the event loop
+    // reusePort must be set on every listen thread sharing the same port, the thread is pinned to the core unless it is negative
+    void start(std::string_view port, std::string_view hostname, EventLoopThread* acceptLoop = nullptr, bool reusePort = false,
+               int core = -1);
+    void updateSettings(const std::shared_ptr<NetAgentSettings>& settingsNew);
     
-    void stop() { forceTerminate = true; } // forces the listen thread to shut down
+    void stop() { forceTerminate = true; wake(); notifyReady(); } // forces the listen thread to shut down, and wakes its waiters
+    bool isStopped() const { return forceTerminate; }
+
+    // non-blocking, consumes returned elements, must only be called from one thread at a time
+    [[nodiscard]] std::vector<SOCKET> getConnectedSockets();
+
+    // becomes readable when connected sockets are ready to hand over, lets the owner wait instead of polling (Linux only, -1 otherwise)
+    int getReadyNotifyFd() const { return readyFd; }
+    bool hasConnectedSockets() const { return numPendingSockets > 0; }
+    // threadsafe, called whenever connected sockets are queued or the thread is stopped, must return quickly, nullptr removes it
+    void setReadyCallback(std::function<void()> callback);
 
-    [[nodiscard]] std::vector<SOCKET> getConnectedSockets(); // threadsafe non-blocking, consumes returned elements
+    // threadsafe, which socket options of the configured tuning took effect on the listen socket and on accepted sockets
+    std::string getTuningReport() const;
 
 protected:
     void threadMain();
     std::thread thread;
     std::string listenPort{};
 	std::string selfHostname{};
+    EventLoopThread* acceptLoop = nullptr;
+    bool reusePort = false;
+    int core = -1;
+    std::shared_ptr<NetAgentSettings> settings = nullptr;
     std::atomic<bool> forceTerminate = false; // may be set by other thread
+
+    // accepts until the backlog is drained, the batch is full, or too many connections are waiting to be handed over
+    void acceptBatch(SOCKET listenSocket);
+    // waits until the listen socket is readable, the thread is woken, or the timeout expires
+    void waitForActivity(SOCKET listenSocket, int timeoutMs);
+    void wake();
     
-    void addConnectedSocket(SOCKET s);
-	size_t getNumNewlyConnected(); // returns number of new connections
-    std::vector<SOCKET> connSockets; // socket connections ready to hand over
-    std::recursive_mutex connSocketsMutex;
-};
\ No newline at end of file
+    void addConnectedSocket(SOCKET s); // threadsafe, may be called by an event loop accepting on behalf of this thread
+    void notifyReady();
+    void tuneAcceptedSocket(SOCKET s); // threadsafe
+    std::string getListenName() const; // port, or unix socket path, for logging
+    mutable std::mutex tuningMutex;
+    Sockets::SocketTuningReport listenTuningReport{};
+    Sockets::SocketTuningReport acceptedTuningReport{};
+    std::atomic<bool> acceptedTuningChecked = false; // inherited options are only read back from the first accepted socket
+    MpscQueue<SOCKET> connSockets; // socket connections ready to hand over
+    std::atomic<size_t> numPendingSockets = 0;
+    std::atomic<bool> overloaded = false; // acceptance paused until pending connections are handed over
+
+    std::mutex readyCallbackMutex;
+    std::function<void()> readyCallback = nullptr;
+    int wakeFd = -1; // eventfd, signalled by stop() and when an overload clears
+    int readyFd = -1; // eventfd, signalled when connected sockets are queued
+};
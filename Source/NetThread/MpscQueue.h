@@ -0,0 +1,60 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#pragma once
+#include <atomic>
+#include <utility>
+
+// lock-free unbounded queue for many producer threads and a single consumer thread (Vyukov's node based MPSC queue)
+// push never blocks or fails, pop must only be called from one thread at a time
+// a pop that races with an unfinished push may report the queue as empty, the element becomes visible once the push completes
+template<typename T>
+class MpscQueue
+{
+public:
+    MpscQueue()
+    {
+        Node* stub = new Node();
+        head.store(stub, std::memory_order_relaxed);
+        tail = stub;
+    }
+    ~MpscQueue()
+    {
+        T discarded;
+        while (pop(discarded)) {}
+        delete tail;
+    }
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    // threadsafe
+    void push(T value)
+    {
+        Node* node = new Node();
+        node->value = std::move(value);
+        Node* previous = head.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+    }
+
+    // consumer thread only, returns false if no element is available
+    bool pop(T& valueOut)
+    {
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (not next)
+            return false;
+        valueOut = std::move(next->value);
+        delete tail;
+        tail = next; // the popped node becomes the new stub
+        return true;
+    }
+
+    // consumer thread only
+    bool empty() const { return tail->next.load(std::memory_order_acquire) == nullptr; }
+
+private:
+    struct Node
+    {
+        std::atomic<Node*> next = nullptr;
+        T value{};
+    };
+    std::atomic<Node*> head; // producers append here
+    Node* tail = nullptr; // consumer side, always points to the stub node
+};
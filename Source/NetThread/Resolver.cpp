@@ -0,0 +1,128 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#include "Resolver.h"
+#include "NetThreadSync.h"
+#include "NetAgent/Agent.h"
+#include "NetAgent/HttpServerUtils/Logging.h"
+#include <future>
+
+Resolver::Resolver(const std::shared_ptr<NetAgentSettings>& settings_)
+    : settings{ settings_ ? settings_ : std::make_shared<NetAgentSettings>() }
+{
+    const size_t numThreads = ESMax(settings->resolverThreads, (size_t)1);
+    for (size_t i = 0; i < numThreads; i++)
+        threads.emplace_back([this] { this->threadMain(); });
+}
+
+Resolver::~Resolver()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        terminate = true;
+    }
+    lookupQueued.notify_all();
+    for (auto& thread : threads)
+        thread.join();
+
+    // nobody will resolve the queued lookups anymore
+    for (auto& [key, callbacks] : waiting)
+    {
+        for (auto& callback : callbacks)
+            callback(Result{});
+    }
+}
+
+void Resolver::resolveAsync(const std::string& hostname, const std::string& port, Callback onResolved)
+{
+    const std::string key = hostname + ":" + port;
+    std::unique_lock<std::mutex> lock(mutex);
+    auto cached = cache.find(key);
+    if (cached != cache.end())
+    {
+        if (Clock::now() < cached->second.expiry)
+        {
+            const Result result = cached->second.result;
+            lock.unlock();
+            onResolved(result);
+            return;
+        }
+        cache.erase(cached);
+    }
+
+    auto& callbacks = waiting[key];
+    callbacks.push_back(std::move(onResolved));
+    if (callbacks.size() > 1)
+        return; // the same hostname is already being looked up
+    queuedLookups.push_back(Lookup{ .key = key, .hostname = hostname, .port = port });
+    lock.unlock();
+    lookupQueued.notify_one();
+}
+
+Resolver::Result Resolver::resolve(const std::string& hostname, const std::string& port, int timeoutMs)
+{
+    auto promise = std::make_shared<std::promise<Result>>(); // shared with the callback, which may outlive this call
+    auto future = promise->get_future();
+    resolveAsync(hostname, port, [promise](const Result& result) { promise->set_value(result); });
+    if (future.wait_for(std::chrono::milliseconds(ESMax(timeoutMs, 0))) != std::future_status::ready)
+        return Result{};
+    return future.get();
+}
+
+void Resolver::clearCache()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    cache.clear();
+}
+
+size_t Resolver::numCached() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return cache.size();
+}
+
+void Resolver::threadMain()
+{
+	WIN_SET_THREAD_NAME(L"Resolver Thread");
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        lookupQueued.wait(lock, [this] { return terminate or not queuedLookups.empty(); });
+        if (terminate)
+            return;
+        const Lookup lookup = std::move(queuedLookups.front());
+        queuedLookups.pop_front();
+
+        // the system resolver blocks, other threads keep serving the cache meanwhile
+        lock.unlock();
+        auto addresses = std::make_shared<std::vector<Sockets::SocketAddress>>();
+        const bool resolved = Sockets::resolveAddresses(lookup.hostname, lookup.port, *addresses);
+        if (not resolved)
+            ESLog::es_detail(ESLog::FormatStr() << "Failed to resolve " << lookup.hostname);
+        const Result result{ .resolved = resolved, .addresses = resolved ? std::move(addresses) : nullptr };
+        lock.lock();
+
+        storeResult(lookup.key, result);
+        auto callbacks = std::move(waiting[lookup.key]);
+        waiting.erase(lookup.key);
+        lock.unlock();
+        for (auto& callback : callbacks)
+            callback(result);
+        lock.lock();
+    }
+}
+
+void Resolver::storeResult(const std::string& key, const Result& result)
+{
+    // getaddrinfo does not report record TTLs, the configured lifetimes act as the TTL for every record
+    const double ttlSec = result.resolved ? settings->resolverCacheTtlSec : settings->resolverNegativeTtlSec;
+    if (ttlSec <= 0.0 or settings->resolverCacheMax == 0)
+        return;
+    if (cache.size() >= settings->resolverCacheMax)
+    {
+        const auto now = Clock::now();
+        std::erase_if(cache, [now](const auto& entry) { return entry.second.expiry <= now; });
+        if (cache.size() >= settings->resolverCacheMax)
+            cache.erase(cache.begin()); // evict an arbitrary entry, the cache is not meant to hold a working set this large
+    }
+    const auto ttl = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(ttlSec));
+    cache[key] = CacheEntry{ .result = result, .expiry = Clock::now() + ttl };
+}
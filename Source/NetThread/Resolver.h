@@ -0,0 +1,58 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#pragma once
+#include "Sockets/Sockets.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <unordered_map>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <string>
+#include <chrono>
+
+class NetAgentSettings;
+
+// asynchronous hostname resolver with an in-process cache, lookups run on a small pool of resolver threads
+// concurrent requests for the same hostname share one lookup, failed lookups are cached for a shorter time (negative caching)
+class Resolver
+{
+public:
+    struct Result
+    {
+        bool resolved = false;
+        std::shared_ptr<const std::vector<Sockets::SocketAddress>> addresses = nullptr; // shared with the cache, never modified
+    };
+    using Callback = std::function<void(const Result&)>;
+
+    explicit Resolver(const std::shared_ptr<NetAgentSettings>& settings);
+    ~Resolver(); // requests still waiting for a lookup complete as unresolved
+    Resolver(const Resolver&) = delete;
+    Resolver& operator=(const Resolver&) = delete;
+
+    // threadsafe, calls onResolved right away if the hostname is cached, otherwise later from a resolver thread
+    void resolveAsync(const std::string& hostname, const std::string& port, Callback onResolved);
+    // threadsafe, blocks until the hostname is resolved, or returns unresolved once the timeout expires
+    Result resolve(const std::string& hostname, const std::string& port, int timeoutMs);
+
+    void clearCache();
+    size_t numCached() const;
+
+protected:
+    using Clock = std::chrono::steady_clock;
+    struct CacheEntry { Result result; Clock::time_point expiry; };
+    struct Lookup { std::string key, hostname, port; };
+
+    void threadMain();
+    void storeResult(const std::string& key, const Result& result); // mutex must be held
+
+    std::shared_ptr<NetAgentSettings> settings = nullptr;
+    mutable std::mutex mutex;
+    std::condition_variable lookupQueued;
+    std::unordered_map<std::string, CacheEntry> cache;
+    std::unordered_map<std::string, std::vector<Callback>> waiting; // callbacks of lookups in progress, by key
+    std::deque<Lookup> queuedLookups;
+    std::vector<std::thread> threads;
+    bool terminate = false;
+};
@@ -0,0 +1,217 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#pragma once
+#include "NetThread/NetThreadSync.h"
+#include "NetThread/BufferPool.h"
+#include <atomic>
+#include <span>
+#include <string_view>
+#include <cstring>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+constexpr size_t ES_SEGMENT_SIZE = 16 * 1024; // a full TLS record, or a typical receive
+constexpr size_t ES_SEGMENT_BUFFER_CAPACITY_MAX = 64 * 1024 * 1024; // a stream falling this far behind is considered stalled
+
+// bytes handed from one producer thread to one consumer thread without locking, stored in a chain of segments from the buffer pool
+// the producer appends segments as it runs out of space and the consumer frees them as it drains them, so bytes are never moved
+// the last drained segment is kept as a spare for the producer, so a steady stream does not go to the pool every segment
+// once written, however much is buffered, the buffered bytes are exported as views (iovecs) for vectored sends and receives
+// the first segment is as small as the caller asks, so a connection that only ever exchanges short messages stays small
+// indices count every byte ever written or read and only grow, each segment holds the bytes from its start index to its end
+class SegmentBuffer
+{
+public:
+    explicit SegmentBuffer(size_t firstSegmentSize, size_t maxCapacity = ES_SEGMENT_BUFFER_CAPACITY_MAX)
+        : maxCapacity{ maxCapacity }
+    {
+        writeSegment = lastSegment = readSegment = new Segment(ESMax(firstSegmentSize, (size_t)64), 0);
+    }
+    ~SegmentBuffer()
+    {
+        while (readSegment)
+            delete std::exchange(readSegment, readSegment->next.load(std::memory_order_relaxed));
+        delete spareSegment.load(std::memory_order_acquire);
+    }
+    SegmentBuffer(const SegmentBuffer&) = delete;
+    SegmentBuffer& operator=(const SegmentBuffer&) = delete;
+
+    // threadsafe, the number of bytes written and not yet read
+    size_t size() const
+    {
+        const size_t read = readIndex.load(std::memory_order_acquire); // loaded first, the write index is never behind it
+        return writeIndex.load(std::memory_order_acquire) - read;
+    }
+
+    // producer: contiguous free space to write into, appends a segment if the last one is full
+    // the span is empty if the buffer holds its maximum capacity
+    std::span<char> writeSpan()
+    {
+        std::span<char> span;
+        writeViews(&span, 1, SIZE_MAX);
+        return span;
+    }
+    // producer: size bytes of free space, less if the maximum capacity is reached or maxViews run out, as views in order
+    // segments are appended as needed, returns the number of views, the bytes written to them are published in order
+    size_t writeViews(std::span<char>* viewsOut, size_t maxViews, size_t size)
+    {
+        const size_t index = writeIndex.load(std::memory_order_relaxed);
+        if (index == writeSegment->end() and not advanceWriteSegment())
+            return 0;
+        size_t numViews = 0;
+        size_t position = index;
+        Segment* segment = writeSegment;
+        while (numViews < maxViews and size > 0)
+        {
+            const size_t viewSize = ESMin(segment->end() - position, size);
+            viewsOut[numViews++] = std::span<char>(segment->data.get() + (position - segment->startIndex), viewSize);
+            size -= viewSize;
+            position = segment->end();
+            if (size == 0 or numViews == maxViews)
+                break;
+            segment = segment->next.load(std::memory_order_relaxed);
+            if (not segment and not (segment = appendSegment()))
+                break;
+        }
+        return numViews;
+    }
+    // producer: makes the next size bytes of the last write views visible to the consumer
+    void publish(size_t size)
+    {
+        const size_t index = writeIndex.load(std::memory_order_relaxed) + size;
+        // the write segment moves on before the index is published, the consumer may free a segment once it has read past it
+        while (index > writeSegment->end() or (index == writeSegment->end() and writeSegment->next.load(std::memory_order_relaxed)))
+            writeSegment = writeSegment->next.load(std::memory_order_relaxed);
+        writeIndex.store(index, std::memory_order_release);
+    }
+
+    // producer: copies all of data or nothing, returns false if it would exceed the maximum capacity
+    bool write(const char* data, size_t size)
+    {
+        if (this->size() + size > maxCapacity)
+            return false;
+        while (size > 0)
+        {
+            const std::span<char> span = writeSpan();
+            if (span.empty())
+                return false; // not reached, segments can always be appended below the maximum capacity
+            const size_t copySize = ESMin(span.size(), size);
+            memcpy(span.data(), data, copySize);
+            publish(copySize);
+            data += copySize;
+            size -= copySize;
+        }
+        return true;
+    }
+
+    // consumer: the contiguous bytes at the front of the buffer, the rest follows in the next span once these are released
+    std::span<const char> readSpan()
+    {
+        const size_t index = readIndex.load(std::memory_order_relaxed);
+        const size_t readable = readableInSegment(index);
+        return std::span<const char>(readSegment->data.get() + (index - readSegment->startIndex), readable);
+    }
+    // consumer: views of the front of the buffer, one per segment, for vectored I/O, returns the number of views
+    size_t peek(std::string_view* viewsOut, size_t maxViews)
+    {
+        const size_t index = readIndex.load(std::memory_order_relaxed);
+        if (maxViews == 0 or readableInSegment(index) == 0) // frees drained segments first
+            return 0;
+        // every view ends at the same write index, a later one would leave a gap where an earlier view ended
+        const size_t written = writeIndex.load(std::memory_order_acquire);
+        size_t numViews = 0;
+        size_t position = index;
+        for (const Segment* segment = readSegment; segment and position < written and numViews < maxViews;
+             segment = segment->next.load(std::memory_order_acquire))
+        {
+            viewsOut[numViews++] = std::string_view(segment->data.get() + (position - segment->startIndex),
+                                                    ESMin(written, segment->end()) - position);
+            position = segment->end();
+        }
+        return numViews;
+    }
+    // consumer: returns the first size readable bytes to the producer
+    void release(size_t size) { readIndex.store(readIndex.load(std::memory_order_relaxed) + size, std::memory_order_release); }
+
+    // consumer: copies and releases up to maxSize bytes, returns the number of bytes copied
+    size_t read(char* dst, size_t maxSize)
+    {
+        size_t copied = 0;
+        while (copied < maxSize)
+        {
+            const std::span<const char> span = readSpan();
+            if (span.empty())
+                break;
+            const size_t copySize = ESMin(span.size(), maxSize - copied);
+            memcpy(dst + copied, span.data(), copySize);
+            release(copySize);
+            copied += copySize;
+        }
+        return copied;
+    }
+
+private:
+    struct Segment
+    {
+        Segment(size_t capacity, size_t startIndex) : data{ BufferPool::makeBuffer(capacity) }, capacity{ capacity }, startIndex{ startIndex } {}
+        size_t end() const { return startIndex + capacity; }
+
+        BufferPool::Buffer data;
+        const size_t capacity;
+        size_t startIndex; // index of the first byte stored in this segment, moves on when the segment is reused
+        std::atomic<Segment*> next = nullptr;
+    };
+
+    // producer, links a segment behind the last one, nullptr if the buffer would exceed its maximum capacity
+    Segment* appendSegment()
+    {
+        if (lastSegment->end() - readIndex.load(std::memory_order_acquire) >= maxCapacity)
+            return nullptr;
+        Segment* segment = spareSegment.exchange(nullptr, std::memory_order_acq_rel); // the consumer is done with the spare's bytes
+        if (segment)
+        {
+            segment->startIndex = lastSegment->end();
+            segment->next.store(nullptr, std::memory_order_relaxed);
+        }
+        else
+            segment = new Segment(ES_SEGMENT_SIZE, lastSegment->end());
+        lastSegment->next.store(segment, std::memory_order_release); // publishes the segment, the consumer may free lastSegment from now on
+        lastSegment = segment;
+        return segment;
+    }
+    // producer, moves on from a full write segment, false if no segment can be appended
+    bool advanceWriteSegment()
+    {
+        Segment* next = writeSegment->next.load(std::memory_order_relaxed);
+        if (not next and not (next = appendSegment()))
+            return false;
+        writeSegment = next;
+        return true;
+    }
+
+    // consumer, frees the segments it has drained, keeping the last full sized one as the spare
+    size_t readableInSegment(size_t index)
+    {
+        while (true)
+        {
+            const size_t written = writeIndex.load(std::memory_order_acquire);
+            if (index < readSegment->end())
+                return ESMin(written, readSegment->end()) - index;
+            Segment* next = readSegment->next.load(std::memory_order_acquire);
+            if (not next)
+                return 0;
+            Segment* drained = std::exchange(readSegment, next);
+            if (drained->capacity == ES_SEGMENT_SIZE)
+                drained = spareSegment.exchange(drained, std::memory_order_acq_rel);
+            delete drained;
+        }
+    }
+
+    const size_t maxCapacity;
+    Segment* writeSegment = nullptr; // producer side, holds the write index, or ends at it with no segment after it
+    Segment* lastSegment = nullptr; // producer side, the end of the chain, segments past writeSegment are empty
+    Segment* readSegment = nullptr; // consumer side, segments from here to lastSegment are chained through next
+    alignas(64) std::atomic<size_t> writeIndex = 0; // separate cache lines keep the two threads from contending
+    alignas(64) std::atomic<size_t> readIndex = 0;
+    std::atomic<Segment*> spareSegment = nullptr; // handed from the consumer back to the producer
+};
@@ -0,0 +1,173 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#include "SendQueue.h"
+#include <cassert>
+#include <cstring>
+
+#ifdef _WIN32
+	#include <io.h>
+	#include <fcntl.h>
+	#include <sys/stat.h>
+#else
+	#include <fcntl.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+std::shared_ptr<const SendFile> SendFile::open(const std::filesystem::path& path)
+{
+#ifdef _WIN32
+	int descriptor = -1;
+	if (_wsopen_s(&descriptor, path.c_str(), _O_RDONLY | _O_BINARY, _SH_DENYNO, _S_IREAD) != 0)
+		return nullptr;
+	struct _stat64 info{};
+	if (_fstat64(descriptor, &info) != 0)
+	{
+		_close(descriptor);
+		return nullptr;
+	}
+#else
+	const int descriptor = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (descriptor == -1)
+		return nullptr;
+	struct stat info{};
+	if (fstat(descriptor, &info) != 0 or not S_ISREG(info.st_mode))
+	{
+		close(descriptor);
+		return nullptr;
+	}
+#endif
+	return std::shared_ptr<const SendFile>(new SendFile(descriptor, (size_t)info.st_size));
+}
+
+SendFile::~SendFile()
+{
+#ifdef _WIN32
+	_close(descriptor);
+#else
+	close(descriptor);
+#endif
+}
+
+size_t SendFile::read(size_t offset, char* dst, size_t maxSize) const
+{
+	if (offset >= size)
+		return 0;
+	maxSize = (maxSize < size - offset) ? maxSize : (size - offset);
+#ifdef _WIN32
+	std::lock_guard<std::mutex> lock(readMutex);
+	if (_lseeki64(descriptor, (long long)offset, SEEK_SET) < 0)
+		return 0;
+	const int readSize = _read(descriptor, dst, (unsigned int)maxSize);
+#else
+	const ssize_t readSize = pread(descriptor, dst, maxSize, (off_t)offset);
+#endif
+	return (readSize > 0) ? (size_t)readSize : 0;
+}
+
+SendSegment::SendSegment(std::shared_ptr<const std::string> storage_)
+	: storage{ std::move(storage_) }
+{
+	size = storage ? storage->size() : 0;
+}
+
+SendSegment SendSegment::fromString(std::string&& data)
+{
+	return SendSegment(std::make_shared<const std::string>(std::move(data)));
+}
+
+SendSegment SendSegment::fromFile(std::shared_ptr<const SendFile> file)
+{
+	SendSegment segment{};
+	segment.size = file ? file->getSize() : 0;
+	segment.file = std::move(file);
+	return segment;
+}
+
+std::string_view SendSegment::view() const
+{
+	if (not storage)
+		return std::string_view();
+	return std::string_view(*storage).substr(offset, size);
+}
+
+void SendQueue::push(SendSegment segment)
+{
+	if (segment.size == 0)
+		return;
+	assert((segment.storage and segment.offset + segment.size <= segment.storage->size()) or
+		(segment.file and segment.offset + segment.size <= segment.file->getSize()));
+	queuedSize += segment.size;
+	segments.push_back(std::move(segment));
+}
+
+size_t SendQueue::peek(std::string_view* viewsOut, size_t maxViews) const
+{
+	size_t numViews = 0;
+	for (const SendSegment& segment : segments)
+	{
+		if (numViews >= maxViews or segment.isFile())
+			break;
+		viewsOut[numViews++] = segment.view();
+	}
+	return numViews;
+}
+
+size_t SendQueue::copyFront(char* dst, size_t maxSize) const
+{
+	if (segments.empty())
+		return 0;
+	const SendSegment& segment = segments.front();
+	const size_t copySize = (maxSize < segment.size) ? maxSize : segment.size;
+	if (segment.isFile())
+		return segment.file->read(segment.offset, dst, copySize);
+	memcpy(dst, segment.storage->data() + segment.offset, copySize);
+	return copySize;
+}
+
+void SendQueue::consume(size_t size)
+{
+	assert(size <= queuedSize);
+	queuedSize -= size;
+	while (size > 0 and not segments.empty())
+	{
+		SendSegment& front = segments.front();
+		if (size < front.size)
+		{
+			// partially sent, the rest is sent from the same storage later
+			front.offset += size;
+			front.size -= size;
+			return;
+		}
+		size -= front.size;
+		segments.pop_front();
+	}
+}
+
+void SendQueue::consumeZerocopy(size_t size, uint32_t sendId)
+{
+	size_t covered = 0;
+	for (const SendSegment& segment : segments)
+	{
+		if (covered >= size)
+			break;
+		assert(not segment.isFile());
+		if (zerocopyPending.empty() or zerocopyPending.back().storage != segment.storage or zerocopyPending.back().sendId != sendId)
+			zerocopyPending.push_back(ZerocopyStorage{ sendId, segment.storage });
+		covered += segment.size;
+	}
+	consume(size);
+}
+
+void SendQueue::releaseZerocopy(uint32_t completedSendId)
+{
+	// send ids wrap around, so they are compared by distance
+	while (not zerocopyPending.empty() and (int32_t)(zerocopyPending.front().sendId - completedSendId) <= 0)
+		zerocopyPending.pop_front();
+}
+
+void SendQueue::clear()
+{
+	segments.clear();
+	zerocopyPending.clear();
+	queuedSize = 0;
+}
@@ -0,0 +1,85 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#pragma once
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <filesystem>
+#include <mutex>
+#include <cstdint>
+
+// an open file that is sent from the kernel page cache (sendfile) where possible, instead of being read into memory
+class SendFile
+{
+public:
+    // returns nullptr if the file cannot be opened
+    static std::shared_ptr<const SendFile> open(const std::filesystem::path& path);
+    ~SendFile();
+    SendFile(const SendFile&) = delete;
+    SendFile& operator=(const SendFile&) = delete;
+
+    size_t getSize() const { return size; }
+    int getDescriptor() const { return descriptor; }
+    // copies part of the file, for paths where the data must pass through memory (TLS, platforms without sendfile)
+    size_t read(size_t offset, char* dst, size_t maxSize) const;
+
+private:
+    SendFile(int descriptor, size_t size) : descriptor{ descriptor }, size{ size } {}
+    int descriptor = -1;
+    size_t size = 0;
+    mutable std::mutex readMutex; // platforms without positional reads must seek before reading
+};
+
+// a block of outgoing data that references storage shared with the caller, the storage is kept alive until the block is sent
+struct SendSegment
+{
+    std::shared_ptr<const std::string> storage = nullptr;
+    std::shared_ptr<const SendFile> file = nullptr; // file backed segments have no storage
+    size_t offset = 0;
+    size_t size = 0;
+
+    SendSegment() = default;
+    // references the whole string
+    explicit SendSegment(std::shared_ptr<const std::string> storage_);
+    // takes ownership of the string without copying its contents
+    static SendSegment fromString(std::string&& data);
+    // references the whole file
+    static SendSegment fromFile(std::shared_ptr<const SendFile> file);
+
+    bool isFile() const { return file != nullptr; }
+    std::string_view view() const; // memory segments only
+};
+
+// ordered outgoing data of a stream, a partially sent segment resumes where the socket stopped accepting data
+// not threadsafe, owners must synchronize access
+class SendQueue
+{
+public:
+    void push(SendSegment segment);
+    bool empty() const { return segments.empty(); }
+    size_t sizeBytes() const { return queuedSize; } // total unsent size
+    size_t numSegments() const { return segments.size(); }
+    const SendSegment* front() const { return segments.empty() ? nullptr : &segments.front(); }
+
+    // fills viewsOut with the unsent data of the front memory segments, stops at the first file segment
+    // returns the number of views written
+    size_t peek(std::string_view* viewsOut, size_t maxViews) const;
+    // copies unsent data from the front segment, whether it is in memory or in a file, returns the size copied
+    size_t copyFront(char* dst, size_t maxSize) const;
+    // removes data that was sent from the front of the queue
+    void consume(size_t size);
+    // removes data that was sent with a zerocopy send, the storage it was sent from stays referenced until releaseZerocopy
+    void consumeZerocopy(size_t size, uint32_t sendId);
+    // releases storage referenced by zerocopy sends up to and including completedSendId
+    void releaseZerocopy(uint32_t completedSendId);
+    size_t numZerocopyPending() const { return zerocopyPending.size(); }
+    void clear();
+
+protected:
+    std::deque<SendSegment> segments;
+    size_t queuedSize = 0;
+
+    // storage the kernel may still be reading from, in send order
+    struct ZerocopyStorage { uint32_t sendId; std::shared_ptr<const std::string> storage; };
+    std::deque<ZerocopyStorage> zerocopyPending;
+};
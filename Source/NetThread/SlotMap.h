@@ -0,0 +1,114 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#pragma once
+#include <vector>
+#include <span>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+// generational slot map, inserting, finding and erasing an element are constant time however many elements are stored
+// a key stays valid until its element is erased, after which it never finds another element, even one reusing the same slot
+// elements are stored densely so iterating them is as fast as over a vector, erasing moves the last element into the hole
+// keys hold the slot index in the low 32 bits and the slot's generation in the high 32 bits, 0 is never a valid key, not threadsafe
+template<typename T>
+class SlotMap
+{
+public:
+    using Key = uint64_t;
+
+    // the key the next insert returns, lets the element know its own key when it is constructed
+    Key nextKey() const
+    {
+        const uint32_t slot = freeSlots.empty() ? static_cast<uint32_t>(slots.size()) : freeSlots.back();
+        const uint32_t generation = (slot < slots.size()) ? slots[slot].generation : 1;
+        return makeKey(slot, generation);
+    }
+
+    Key insert(T value)
+    {
+        const Key key = nextKey();
+        const uint32_t slot = slotOf(key);
+        if (freeSlots.empty())
+            slots.push_back(Slot{});
+        else
+            freeSlots.pop_back();
+        slots[slot].denseIndex = static_cast<uint32_t>(values.size());
+        values.push_back(std::move(value));
+        denseSlots.push_back(slot);
+        return key;
+    }
+
+    // nullptr if the key's element has been erased, the pointer is valid until the map is next modified
+    T* find(Key key)
+    {
+        const uint32_t slot = slotOf(key);
+        if (slot >= slots.size() or slots[slot].generation != generationOf(key) or slots[slot].denseIndex == ES_SLOT_FREE)
+            return nullptr;
+        return &values[slots[slot].denseIndex];
+    }
+    const T* find(Key key) const { return const_cast<SlotMap*>(this)->find(key); }
+    bool contains(Key key) const { return find(key) != nullptr; }
+
+    bool erase(Key key)
+    {
+        if (not find(key))
+            return false;
+        eraseAt(slots[slotOf(key)].denseIndex);
+        return true;
+    }
+
+    // erases every element the predicate returns true for, the predicate may not modify the map
+    template<typename Predicate>
+    size_t eraseIf(Predicate&& predicate)
+    {
+        size_t numErased = 0;
+        // backwards, the element moved into a hole has already been visited
+        for (size_t i = values.size(); i-- > 0;)
+        {
+            if (predicate(values[i]))
+            {
+                eraseAt(static_cast<uint32_t>(i));
+                numErased++;
+            }
+        }
+        return numErased;
+    }
+
+    size_t size() const { return values.size(); }
+    bool empty() const { return values.empty(); }
+    // the elements in no particular order, erasing an element moves another one into its place
+    std::span<T> all() { return values; }
+    std::span<const T> all() const { return values; }
+
+private:
+    static constexpr uint32_t ES_SLOT_FREE = UINT32_MAX;
+    struct Slot { uint32_t generation = 1; uint32_t denseIndex = ES_SLOT_FREE; };
+
+    static Key makeKey(uint32_t slot, uint32_t generation) { return (static_cast<Key>(generation) << 32) | slot; }
+    static uint32_t slotOf(Key key) { return static_cast<uint32_t>(key); }
+    static uint32_t generationOf(Key key) { return static_cast<uint32_t>(key >> 32); }
+
+    void eraseAt(uint32_t denseIndex)
+    {
+        Slot& slot = slots[denseSlots[denseIndex]];
+        // the generation wraps around past 0, which would make key 0 valid
+        slot.generation = (slot.generation == UINT32_MAX) ? 1 : slot.generation + 1;
+        slot.denseIndex = ES_SLOT_FREE;
+        freeSlots.push_back(denseSlots[denseIndex]);
+
+        const uint32_t last = static_cast<uint32_t>(values.size() - 1);
+        if (denseIndex != last)
+        {
+            values[denseIndex] = std::move(values[last]);
+            denseSlots[denseIndex] = denseSlots[last];
+            slots[denseSlots[denseIndex]].denseIndex = denseIndex;
+        }
+        values.pop_back();
+        denseSlots.pop_back();
+    }
+
+    std::vector<Slot> slots;
+    std::vector<T> values;
+    std::vector<uint32_t> denseSlots; // slot of each element in values
+    std::vector<uint32_t> freeSlots; // reused most recently freed first
+};
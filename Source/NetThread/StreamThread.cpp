@@ -1,8 +1,11 @@
 // Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
 #include "StreamThread.h"
+#include "EventLoopThread.h"
+#include "ThreadPlacement.h"
 #include "NetAgent/HttpServerUtils/Logging.h"
 #include "NetAgent/HttpServerUtils/BearSSL/inc/TLSInterface.h"
 #include "NetAgent/Agent.h"
+#include "NetThread/Resolver.h"
 #include <cassert>
 #include <limits.h>
 #include <cstring>
@@ -10,6 +13,10 @@
 
 #include <iostream>
 
+// client: delay before retrying a connection after every address failed, doubles after each failure up to the maximum (milliseconds)
+constexpr int ES_CONNECT_RETRY_DELAY_MIN_MS = 50;
+constexpr int ES_CONNECT_RETRY_DELAY_MAX_MS = 1000;
+
 StreamThread::StreamThread(size_t sendBufferSize, size_t receiveBufferSize, StreamEncryptionMode encryptMode)
     : sendBuffer{ sendBufferSize }, recvBuffer{ receiveBufferSize }
 {
@@ -19,13 +26,20 @@ StreamThread::StreamThread(size_t sendBufferSize, size_t receiveBufferSize, Stre
 StreamThread::~StreamThread() 
 { 
     stop();
-    thread.join();
+    // a connecting client thread may still hand the stream to an event loop, so it is joined first
+    if (thread.joinable())
+        thread.join();
+    if (EventLoopThread* loop = eventLoop.load())
+        loop->removeStream(eventLoopKey);
 }
 
-void StreamThread::start(std::string_view hostname_, std::string_view port_)
+void StreamThread::start(std::string_view hostname_, std::string_view port_, Resolver* resolver_, EventLoopThread* loop)
 {
     hostname = hostname_;
     port = port_;
+    resolver = resolver_;
+    connectLoop = loop;
+    connecting = true;
     start(INVALID_SOCKET);
 }
 
@@ -35,17 +49,71 @@ void StreamThread::start(SOCKET socket_)
     
     if (socket_ != INVALID_SOCKET)
     {
-        // assumes socket is already connected (server mode)
+        // assumes socket is already connected (server mode), accepted sockets are non-blocking but the stream thread expects blocking calls
         socket.set(socket_);
+        Sockets::setBlocking(socket_, true);
+        initZerocopy(socket_);
         streamConnected = true;
     }
     // start thread
     thread = std::thread([this] { this->threadMain(); }); 
 }
 
+void StreamThread::start(SOCKET socket_, EventLoopThread* loop)
+{
+    if (not loop)
+        return start(socket_);
+    if (streamConnected or socket_ == INVALID_SOCKET) { return; }
+    attachToEventLoop(socket_, loop);
+}
+
+// the event loop requires non-blocking sockets, it never waits on a single connection
+bool StreamThread::attachToEventLoop(SOCKET s, EventLoopThread* loop)
+{
+    socket.set(s);
+    Sockets::setBlocking(s, false);
+    initZerocopy(s);
+    lastComTimer.start();
+    streamConnected = true; // before the loop can service the stream, or check it for timeouts
+    eventLoopKey = loop->addStream(this, s);
+    if (not eventLoopKey)
+    {
+        streamConnected = false;
+        connectionFailure = true;
+        return false;
+    }
+    eventLoop.store(loop, std::memory_order_release);
+    return true;
+}
+
+void StreamThread::setActivityCallback(std::function<void()> callback)
+{
+	std::lock_guard<std::mutex> lock(activityMutex);
+	activityCallback = std::move(callback);
+	activityWatched.store(activityCallback != nullptr, std::memory_order_seq_cst);
+}
+
+void StreamThread::notifyActivity()
+{
+	// pairs with a waiter registering its callback before checking the buffers again, it either sees the activity or is called
+	if (not activityWatched.load(std::memory_order_seq_cst))
+		return;
+	std::lock_guard<std::mutex> lock(activityMutex);
+	if (activityCallback)
+		activityCallback();
+}
+
+void StreamThread::notifyEventLoop()
+{
+    // the event loop only wakes on readiness, it must be told that there is new data to send
+    if (EventLoopThread* loop = eventLoop.load(std::memory_order_acquire))
+        loop->notifySend(eventLoopKey);
+}
+
 void StreamThread::threadMain()
 {
 	WIN_SET_THREAD_NAME(L"Stream Thread");
+    ThreadPlacement::pinCurrentThread(settings->workerCores);
     bool terminate = false;
 
     // resolve hostname and connect (client mode only)
@@ -54,14 +122,31 @@ void StreamThread::threadMain()
         Timer t;
         t.start();
         SOCKET s;
-        while (!t.checkTimeout(settings->clientConnectTimeoutSec))
+        int retryDelayMs = ES_CONNECT_RETRY_DELAY_MIN_MS;
+        while (!forceTerminate)
         {
-            if (Sockets::setupStream(hostname, port, s))
+            const double remainingMs = settings->clientConnectTimeoutSec * 1000.0 - t.getElapsedMs();
+            if (remainingMs <= 0.0)
+                break;
+            if (connectToHost(s, (int)remainingMs))
             {
+                if (connectLoop)
+                {
+                    // from here on the event loop services the stream, data queued while connecting is sent right away
+                    if (attachToEventLoop(s, connectLoop))
+                        notifyEventLoop();
+                    connecting = false;
+                    notifyActivity();
+                    return;
+                }
                 socket.set(s);
+                initZerocopy(s);
                 streamConnected = true;
                 break;
             }
+            // every address failed (such as refused or unreachable), back off before resolving and trying again
+            Sockets::threadSleep((int)ESMin((double)retryDelayMs, ESMax(settings->clientConnectTimeoutSec * 1000.0 - t.getElapsedMs(), 0.0)));
+            retryDelayMs = ESMin(retryDelayMs * 2, ES_CONNECT_RETRY_DELAY_MAX_MS);
         }
         if (!streamConnected) 
         { 
@@ -69,6 +154,7 @@ void StreamThread::threadMain()
             terminate = true;
             connectionFailure = true;
         }
+        connecting = false;
     }
 
 	{
@@ -77,13 +163,14 @@ void StreamThread::threadMain()
 			terminate = true;
 	}
 	lastComTimer.start();
+	notifyActivity(); // connected, or failed to connect
 
     // thread main loop
     while (!terminate)
     {
 		bool didSend, didRecv;
         // send
-		if (encryption.enabled())
+		if (encryption.enabled() and not kernelTlsSend)
 			didSend = threadSendDataTLS(lastComTimer, terminate);
 		else
 			didSend = threadSendData(lastComTimer, terminate);
@@ -95,6 +182,9 @@ void StreamThread::threadMain()
 			didRecv = threadReceiveData(lastComTimer, terminate);
 
 		updateBuffersTLS(recvBuffer, sendBuffer, terminate);
+		checkWritable();
+		if (didSend or didRecv)
+			notifyActivity();
 
 		const double delta = lastComTimer.getElapsed();
 		if (delta > settings->communicationGapMaxSec)
@@ -114,52 +204,192 @@ void StreamThread::threadMain()
         terminate = forceTerminate or terminate;
     }
     streamConnected = false;
+    notifyActivity();
+}
+
+// client: resolves the hostname, through the resolver cache when available, and connects to the fastest address
+bool StreamThread::connectToHost(SOCKET& socketOut, int timeoutMs)
+{
+	const Sockets::SocketTuning& tuning = settings->socketTuning;
+	bool connected = false;
+	if (not resolver or Sockets::isUnixAddress(hostname))
+		connected = Sockets::setupStream(hostname, port, socketOut, timeoutMs, tuning);
+	else
+	{
+		Timer timer;
+		timer.start();
+		const Resolver::Result resolved = resolver->resolve(hostname, port, timeoutMs);
+		if (not resolved.resolved)
+			return false;
+		connected = Sockets::connectSocket(*resolved.addresses, socketOut, ESMax(timeoutMs - (int)timer.getElapsedMs(), 1), tuning);
+	}
+	if (connected and not tuning.isDefault())
+	{
+		ESLog::es_detail(ESLog::FormatStr() << "Client socket options: "
+						 << Sockets::readSocketTuning(socketOut, tuning, Sockets::SocketRole::Connecting).toString());
+	}
+	return connected;
 }
 
 // when using TLS, data is sent from the encryption library buffer
 bool StreamThread::threadSendDataTLS(Timer& lastComTimer, bool& terminate)
 {
 	assert(encryption.enabled());
-
-	// TODO: small optimization: could avoid copying the data here
 	Lock socketLock;
-	std::string encrypted;
-	if ((not encryption.context->getEncryptedOutgoing(encrypted)) or encrypted.size() == 0)
-	{
+	SOCKET s = socket.get(socketLock); // lock socket mutex, released at end of scope
+	const bool didSend = sendDataTLS(s, terminate);
+	enableKernelTls(s);
+	if (not didSend)
 		return false;
+	lastComTimer.start();
+	return true;
+}
+
+// sends the send buffer followed by the queued segments with one vectored call, unsent data stays queued
+// returns the number of bytes sent, 0 if there was nothing to send, or -1 on socket error
+int64_t StreamThread::sendGathered(SOCKET s)
+{
+	// while no segments are queued only the send buffer is sent, without locking, data queued meanwhile lands behind it
+	Lock queueLock;
+	if (sendQueueUsed.load(std::memory_order_acquire))
+		queueLock = Lock(sendQueueMutex); // the send buffer is peeked under the lock, nothing can be added to it ahead of the segments
+
+	std::array<std::string_view, Sockets::ES_SEND_VECTOR_MAX> views;
+	size_t numViews = sendBuffer.peek(views.data(), views.size());
+	size_t readable = 0;
+	for (size_t i = 0; i < numViews; i++)
+		readable += views[i].size();
+	const size_t numSegmentViews = queueLock ? sendQueue.peek(views.data() + numViews, views.size() - numViews) : 0;
+	numViews += numSegmentViews;
+	if (numViews == 0)
+		return queueLock ? sendFileSegment(s) : 0; // nothing in memory ahead of a file segment
+
+	uint32_t flags = 0;
+	// a file segment right behind a short header should leave in the same packets
+	if (queueLock and sendQueue.numSegments() > numSegmentViews)
+		flags |= Sockets::ES_SEND_MORE;
+	// segments keep their storage alive until the kernel is done with it, the send buffer is reused immediately so it is always copied
+	bool zerocopy = false;
+	if (zerocopyEnabled and readable == 0)
+	{
+		size_t viewsSize = 0;
+		for (size_t i = 0; i < numViews; i++)
+			viewsSize += views[i].size();
+		zerocopy = (viewsSize >= settings->sendZerocopyMinSize);
 	}
+	if (zerocopy)
+		flags |= Sockets::ES_SEND_ZEROCOPY;
+
+	const int64_t sizeSent = Sockets::sendVectored(s, views.data(), numViews, flags);
+	if (sizeSent <= 0)
+		return -1;
+	const size_t sentFromBuffer = ESMin((size_t)sizeSent, readable);
+	sendBuffer.release(sentFromBuffer);
+	if (not queueLock)
+		return sizeSent;
+	if (zerocopy)
+		sendQueue.consumeZerocopy((size_t)sizeSent, zerocopyNextSendId++);
+	else
+		sendQueue.consume((size_t)sizeSent - sentFromBuffer);
+	sendQueueUsed.store(not sendQueue.empty(), std::memory_order_release);
+	return sizeSent;
+}
 
-	SOCKET s = socket.get(socketLock); // lock socket mutex, released at end of scope
-	// send using encryption library as the data source
-	// TODO: all the data might not be sent at once, in that case some will be lost (could be handled better)
-	const size_t sizeSent = Sockets::sendData(s, encrypted.c_str(), encrypted.size());
-	if (sizeSent != encrypted.size())
+// enables zerocopy sends if requested in the settings, TLS streams send from the encryption library buffer which is always copied
+void StreamThread::initZerocopy(SOCKET s)
+{
+	zerocopyEnabled = settings and settings->sendZerocopy and not encryption.enabled() and Sockets::enableZerocopy(s);
+}
+
+// once the handshake and every record encrypted so far have been sent, hands encryption of outgoing records to the kernel if enabled
+// in the settings, encrypted streams then send as unencrypted ones do, including files through sendfile
+// received records are still decrypted by the encryption library, which may already hold the start of the next record
+void StreamThread::enableKernelTls(SOCKET s)
+{
+	if (kernelTlsAttempted or not settings->kernelTls or not encryption.enabled())
+		return;
+	if (not encryption.context->isHandshakeComplete() or not pendingEncrypted.empty() or encryption.context->hasEncryptedOutgoing())
+		return;
+	kernelTlsAttempted = true;
+
+	Encryption::TrafficKeys keys{};
+	if (not encryption.context->exportOutgoingKeys(keys))
 	{
-		ESLog::es_detail("Connection thread terminating: attempt to send failed");
-		terminate = true;
-		return false;
+		ESLog::es_detail("Kernel TLS not used for connection: the cipher suite cannot be offloaded");
+		return;
 	}
+	Sockets::KernelTlsCipher cipher = Sockets::KernelTlsCipher::Aes128Gcm;
+	if (keys.cipher == Encryption::TrafficCipher::AES_256_GCM)
+		cipher = Sockets::KernelTlsCipher::Aes256Gcm;
+	else if (keys.cipher == Encryption::TrafficCipher::CHACHA20_POLY1305)
+		cipher = Sockets::KernelTlsCipher::ChaCha20Poly1305;
+	kernelTlsSend = Sockets::enableKernelTlsSend(s, cipher, keys.key, keys.keySize, keys.iv, keys.ivSize, keys.sequence);
+	if (not kernelTlsSend)
+		ESLog::es_detail("Kernel TLS is not available, encrypting in user space");
+}
 
-	lastComTimer.start();
-	return true;
+// releases the storage of zerocopy sends the kernel has completed
+void StreamThread::releaseZerocopySends(SOCKET s)
+{
+	auto queueLock = Lock(sendQueueMutex);
+	if (sendQueue.numZerocopyPending() == 0)
+		return;
+	uint32_t completedId = 0;
+	bool copied = false;
+	if (not Sockets::readZerocopyCompletions(s, completedId, copied))
+		return;
+	sendQueue.releaseZerocopy(completedId);
+	if (copied and zerocopyEnabled)
+	{
+		// the route does not support zerocopy (such as loopback), the kernel copies the data anyway
+		zerocopyEnabled = false;
+		ESLog::es_detail("Zerocopy sends disabled for connection: the kernel copied the data");
+	}
 }
 
-// when unencrypted, send data from the send buffer
-bool StreamThread::threadSendData(Timer& lastComTimer, bool& terminate)
+// sends from the file segment at the front of the send queue, sendQueueMutex must be held
+int64_t StreamThread::sendFileSegment(SOCKET s)
 {
-	assert(not encryption.enabled());
-	Lock socketLock, bufferLock;
-	size_t readable = 0;
-	auto* buf = sendBuffer.getBufferForRead(bufferLock, readable);
-	if (not (readable and buf))
-		return false;
+	const SendSegment* front = sendQueue.front();
+	if (not front)
+		return 0;
+	assert(front->isFile());
+
+	int64_t sizeSent = -1;
+	if (Sockets::sendFileSupported())
+	{
+		sizeSent = Sockets::sendFile(s, front->file->getDescriptor(), front->offset, ESMin(front->size, ES_SENDFILE_CHUNK_MAX));
+	}
+	else
+	{
+		std::array<char, 16384> chunk;
+		const size_t chunkSize = sendQueue.copyFront(chunk.data(), chunk.size());
+		if (chunkSize == 0)
+			return -1;
+		const std::string_view view(chunk.data(), chunkSize);
+		sizeSent = Sockets::sendVectored(s, &view, 1);
+	}
+	if (sizeSent <= 0)
+		return -1;
+	sendQueue.consume((size_t)sizeSent);
+	sendQueueUsed.store(not sendQueue.empty(), std::memory_order_release);
+	return sizeSent;
+}
 
+// when unencrypted, send data from the send buffer and send queue directly
+bool StreamThread::threadSendData(Timer& lastComTimer, bool& terminate)
+{
+	assert(not encryption.enabled() or kernelTlsSend);
+	Lock socketLock;
 	SOCKET s = socket.get(socketLock); // lock socket mutex, released at end of scope
-	// using the send buffer directly
-	const size_t sizeSent = Sockets::sendData(s, buf, readable);
-	sendBuffer.read(sizeSent);
-	if (not sizeSent)
+	releaseZerocopySends(s);
+	const int64_t sizeSent = sendGathered(s);
+	if (sizeSent == 0)
+		return false;
+	if (sizeSent < 0)
 	{
+		if (Sockets::lastErrorWouldBlock())
+			return false; // interrupted, the unsent data is still queued
 		ESLog::es_detail("Connection thread terminating: attempt to send returned socket error");
 		terminate = true;
 		return false;
@@ -179,14 +409,8 @@ bool StreamThread::threadReceiveDataTLS(Timer& lastComTimer, bool& terminate)
 
 	// get the size available to receive on socket
 	auto canRecvSize = Sockets::getReceiveSize(s);
-	if (canRecvSize == 0 or not encryption.context->canPushIncoming())
-	{
-		return false;
-	}
-	if (canRecvSize > 5e7)
+	if (canRecvSize == 0 or not encryption.context->canPushIncoming() or not receiveAllowed())
 	{
-		terminate = true; // end the connection if the network buffer grows too large
-		ESLog::es_detail("Connection thread terminating: received data too large");
 		return false;
 	}
 
@@ -196,9 +420,15 @@ bool StreamThread::threadReceiveDataTLS(Timer& lastComTimer, bool& terminate)
 
 	// allocate a temporary buffer to hold encrypted data
 	// TODO: small optimization: could avoid copying the data here
-	std::unique_ptr<char[]> encrypted = std::unique_ptr<char[]>(new char[sizeToReceive]);
+	BufferPool::Buffer encrypted = BufferPool::makeBuffer(sizeToReceive);
 	// receive
-	size_t receivedSize = Sockets::receiveData(s, encrypted.get(), sizeToReceive);
+	const int32_t receivedSize = Sockets::receiveData(s, encrypted.get(), sizeToReceive);
+	if (receivedSize <= 0)
+	{
+		terminate = true; // the socket reported data, so nothing received means it was closed or failed
+		ESLog::es_detail("Connection thread terminating: attempt to receive returned socket error");
+		return false;
+	}
 	// push received data to encryption library
 	encryption.context->pushEncryptedIncoming(encrypted.get(), receivedSize);
 	lastComTimer.start();
@@ -209,36 +439,41 @@ bool StreamThread::threadReceiveDataTLS(Timer& lastComTimer, bool& terminate)
 bool StreamThread::threadReceiveData(Timer& lastComTimer, bool& terminate)
 {
 	assert(not encryption.enabled());
-	Lock socketLock, bufferLock;
+	Lock socketLock;
 	SOCKET s = socket.get(socketLock); // lock socket mutex, released at end of scope
 	// get the size available to receive on socket
 	auto sizeToReceive = Sockets::getReceiveSize(s);
 
-	if (sizeToReceive == 0)
-		return false;
-	if (sizeToReceive > 5e7)
+	if (sizeToReceive == 0 or not receiveAllowed())
+		return false; // while paused the data waits in the kernel, which shrinks the window the peer may send into
+
+	// write received data directly to the receive buffer, the rest is received on the next iteration if it needs more segments
+	// than one call fills, or once the application has taken enough for the receive high watermark to allow it
+	const size_t buffered = recvBuffer.size();
+	const size_t room = (buffered < settings->receiveHighWatermark) ? settings->receiveHighWatermark - buffered : 1;
+	const size_t receiveSize = ESMin(sizeToReceive, room);
+	std::array<std::span<char>, Sockets::ES_RECEIVE_VECTOR_MAX> views;
+	const size_t numViews = recvBuffer.writeViews(views.data(), views.size(), receiveSize);
+	if (numViews == 0)
 	{
-		terminate = true; // end the connection if the network buffer grows too large
+		terminate = true; // end the connection if the application is not consuming received data
 		ESLog::es_detail("Connection thread terminating: received data too large");
 		return false;
 	}
-
-	auto* buf = recvBuffer.getBufferForWrite(bufferLock, sizeToReceive);
-	if (not buf)
+	const int64_t receivedSize = Sockets::receiveVectored(s, views.data(), numViews);
+	if (receivedSize <= 0)
 	{
-		terminate = true;
-		ESLog::es_error("Connection thread terminating: receive buffer allocation failed");
+		terminate = true; // the socket reported data, so nothing received means it was closed or failed
+		ESLog::es_detail("Connection thread terminating: attempt to receive returned socket error");
 		return false;
 	}
-
-	// write received data directly to the receive buffer
-	size_t receivedSize = Sockets::receiveData(s, buf, sizeToReceive);
-	recvBuffer.written(receivedSize);
+	recvBuffer.publish((size_t)receivedSize);
 	lastComTimer.start();
+	return true;
 }
 
 // when using TLS the encryption buffers must communicate with the regular buffers
-void StreamThread::updateBuffersTLS(NetBufferAdvanced& recvBuffer, NetBufferAdvanced& sendBuffer, bool& terminate)
+void StreamThread::updateBuffersTLS(SegmentBuffer& recvBuffer, SegmentBuffer& sendBuffer, bool& terminate)
 {
 	if (not encryption.enabled())
 		return;
@@ -250,21 +485,47 @@ void StreamThread::updateBuffersTLS(NetBufferAdvanced& recvBuffer, NetBufferAdva
 		return;
 	}
 
-	// push data to be encrypted, from send buffer
-	if (encryption.context->canPushOutgoing())
+	if (kernelTlsSend and encryption.context->hasEncryptedOutgoing())
+	{
+		// the encryption library has a record of its own to send (such as an alert), the kernel would encrypt it a second time
+		ESLog::es_detail("Connection thread terminating: TLS record after kernel offload");
+		terminate = true;
+		return;
+	}
+
+	// push data to be encrypted, from send buffer, then from the send queue once the buffer is empty
+	if (not kernelTlsSend and encryption.context->canPushOutgoing())
 	{
 		const size_t pushSizeMax = encryption.context->getPushMaxSizeOutgoing();
-		size_t pushableSize = 0;
-		Lock sendBufferLock;
-		auto* buf = sendBuffer.getBufferForRead(sendBufferLock, pushableSize);
-		if (pushableSize > 0 and pushSizeMax > 0 and buf)
+		const std::span<const char> buf = sendBuffer.readSpan();
+		if (not buf.empty() and pushSizeMax > 0)
 		{
-			const size_t sizeToPush = ESMin(pushableSize, pushSizeMax);
-			const size_t sizePushed = encryption.context->pushOutgoing(buf, sizeToPush);
+			const size_t sizeToPush = ESMin(buf.size(), pushSizeMax);
+			const size_t sizePushed = encryption.context->pushOutgoing(buf.data(), sizeToPush);
 			if (sizePushed != sizeToPush)
 				ESLog::es_error("Failed to push data to encryption buffer");
-			sendBuffer.read(sizePushed);
-			//ESLog::es_detail(ESLog::FormatStr() << "To be encrypted: '" << std::string(buf, sizeToPush) << "'");
+			sendBuffer.release(sizePushed);
+			//ESLog::es_detail(ESLog::FormatStr() << "To be encrypted: '" << std::string(buf.data(), sizeToPush) << "'");
+		}
+		else if (pushSizeMax > 0 and sendQueueUsed.load(std::memory_order_acquire))
+		{
+			auto sendQueueLock = Lock(sendQueueMutex);
+			// data queued to the buffer since it was checked is ahead of the segments, it is pushed on the next update
+			if (sendBuffer.size() == 0)
+			{
+				std::string_view segment;
+				std::array<char, 16384> fileChunk;
+				if (sendQueue.peek(&segment, 1) == 0)
+					segment = std::string_view(fileChunk.data(), sendQueue.copyFront(fileChunk.data(), ESMin(fileChunk.size(), pushSizeMax)));
+				const size_t sizePushed = encryption.context->pushOutgoing(segment.data(), ESMin(segment.size(), pushSizeMax));
+				sendQueue.consume(sizePushed);
+				sendQueueUsed.store(not sendQueue.empty(), std::memory_order_release);
+				if (segment.empty())
+				{
+					ESLog::es_detail("Connection thread terminating: failed to read file being sent");
+					terminate = true;
+				}
+			}
 		}
 	}
 
@@ -272,18 +533,334 @@ void StreamThread::updateBuffersTLS(NetBufferAdvanced& recvBuffer, NetBufferAdva
 	std::string incomingDecrypted;
 	if (encryption.context->getDecryptedIncoming(incomingDecrypted))
 	{
-		Lock recvBufferLock;
-		auto* buf = recvBuffer.getBufferForWrite(recvBufferLock, incomingDecrypted.size());
-		if (buf and incomingDecrypted.size())
+		if (not recvBuffer.write(incomingDecrypted.data(), incomingDecrypted.size()))
 		{
-			memcpy(buf, incomingDecrypted.data(), incomingDecrypted.size());
-			recvBuffer.written(incomingDecrypted.size());
-			//ESLog::es_detail(ESLog::FormatStr() << "Decrypted: '" << incomingDecrypted << "'");
+			terminate = true; // end the connection if the application is not consuming received data
+			ESLog::es_detail("Connection terminating: received data too large");
 		}
+		//ESLog::es_detail(ESLog::FormatStr() << "Decrypted: '" << incomingDecrypted << "'");
 	}
 	
 }
 
+// event loop mode: called by the event loop thread whenever the socket is ready, or data was queued to send
+bool StreamThread::pumpEvents()
+{
+	bool terminate = forceTerminate;
+	bool progress = true;
+	bool anyProgress = false;
+	while (progress and not terminate)
+	{
+		Lock socketLock;
+		SOCKET s = socket.get(socketLock); // lock socket mutex, released at end of scope
+
+		// edge-triggered readiness is only reported once, so everything available is consumed here
+		bool didRecv, didSend;
+		if (encryption.enabled())
+			didRecv = loopReceiveDataTLS(s, terminate);
+		else
+			didRecv = loopReceiveData(s, terminate);
+
+		updateBuffersTLS(recvBuffer, sendBuffer, terminate);
+
+		if (encryption.enabled() and not kernelTlsSend)
+		{
+			didSend = sendDataTLS(s, terminate);
+			enableKernelTls(s);
+		}
+		else
+		{
+			releaseZerocopySends(s);
+			didSend = loopSendData(s, terminate);
+		}
+
+		progress = (didRecv or didSend);
+		if (progress)
+			lastComTimer.start();
+		anyProgress = anyProgress or progress;
+	}
+
+	if (terminate)
+		streamConnected = false;
+	else
+		checkWritable();
+	if (anyProgress or terminate)
+		notifyActivity();
+	return not terminate;
+}
+
+bool StreamThread::checkRunning()
+{
+	if (forceTerminate or not streamConnected)
+	{
+		streamConnected = false;
+		notifyActivity();
+		return false;
+	}
+	return true;
+}
+
+bool StreamThread::checkTimeouts(double& idleRemainingMsOut)
+{
+	if (not checkRunning())
+		return false;
+	idleRemainingMsOut = settings->communicationGapMaxSec * 1000.0 - lastComTimer.getElapsedMs();
+	if (idleRemainingMsOut <= 0.0)
+	{
+		ESLog::es_detail("Connection terminating: comms delta timeout");
+		streamConnected = false;
+		notifyActivity();
+		return false;
+	}
+	return true;
+}
+
+void StreamThread::closeFromEventLoop()
+{
+	ESLog::es_detail("Connection terminating: socket error");
+	streamConnected = false;
+	notifyActivity();
+}
+
+// event loop mode: sends from the send buffer and send queue until both are empty or the socket would block
+bool StreamThread::loopSendData(SOCKET s, bool& terminate)
+{
+	assert(not encryption.enabled() or kernelTlsSend);
+	bool didSend = false;
+	while (not terminate)
+	{
+		const int64_t sizeSent = sendGathered(s);
+		if (sizeSent == 0)
+			break;
+		if (sizeSent < 0)
+		{
+			if (not Sockets::lastErrorWouldBlock())
+			{
+				ESLog::es_detail("Connection terminating: attempt to send returned socket error");
+				terminate = true;
+			}
+			break; // socket buffer is full, sending continues on the next writable event
+		}
+		didSend = true;
+	}
+	return didSend;
+}
+
+// sends encrypted data until the encryption library has none left, whatever the socket does not accept stays in pendingEncrypted
+// and is sent first on the next call, so a short send never loses data
+bool StreamThread::sendDataTLS(SOCKET s, bool& terminate)
+{
+	assert(encryption.enabled());
+	bool didSend = false;
+	while (not terminate)
+	{
+		if (pendingEncrypted.empty() and not encryption.context->getEncryptedOutgoing(pendingEncrypted))
+			break;
+		if (pendingEncrypted.empty())
+			break;
+
+		const int64_t sizeSent = Sockets::sendData(s, pendingEncrypted.data(), pendingEncrypted.size());
+		if (sizeSent <= 0)
+		{
+			if (not Sockets::lastErrorWouldBlock())
+			{
+				ESLog::es_detail("Connection terminating: attempt to send failed");
+				terminate = true;
+			}
+			break; // socket buffer is full, the rest is sent on the next call
+		}
+		pendingEncrypted.erase(0, sizeSent);
+		didSend = true;
+	}
+	return didSend;
+}
+
+// event loop mode: receives into the receive buffer until the socket has no more data
+bool StreamThread::loopReceiveData(SOCKET s, bool& terminate)
+{
+	assert(not encryption.enabled());
+	constexpr size_t chunkSize = ES_SEGMENT_SIZE;
+	bool didRecv = false;
+	std::array<std::span<char>, Sockets::ES_RECEIVE_VECTOR_MAX> views;
+	while (not terminate and receiveAllowed())
+	{
+		// the free space left in the last segment and a new segment behind it are filled by one call, up to the high watermark
+		const size_t buffered = recvBuffer.size();
+		const size_t room = (buffered < settings->receiveHighWatermark) ? settings->receiveHighWatermark - buffered : 1;
+		const size_t numViews = recvBuffer.writeViews(views.data(), views.size(), ESMin(chunkSize, room));
+		if (numViews == 0)
+		{
+			terminate = true; // end the connection if the application is not consuming received data
+			ESLog::es_detail("Connection terminating: received data too large");
+			break;
+		}
+
+		const int64_t receivedSize = Sockets::receiveVectored(s, views.data(), numViews);
+		if (receivedSize > 0)
+		{
+			recvBuffer.publish(receivedSize);
+			didRecv = true;
+		}
+		else if (receivedSize == 0)
+		{
+			terminate = true; // orderly shutdown by the peer
+			ESLog::es_detail("Connection terminating: closed by peer");
+		}
+		else
+		{
+			if (not Sockets::lastErrorWouldBlock())
+			{
+				terminate = true;
+				ESLog::es_detail("Connection terminating: attempt to receive returned socket error");
+			}
+			break; // no more data available
+		}
+	}
+	return didRecv;
+}
+
+// event loop mode: receives encrypted data into the encryption library, as much as it can accept
+bool StreamThread::loopReceiveDataTLS(SOCKET s, bool& terminate)
+{
+	assert(encryption.enabled());
+	bool didRecv = false;
+	std::array<char, 16384> encrypted;
+	while (not terminate and encryption.context->canPushIncoming() and receiveAllowed())
+	{
+		const size_t sizeToReceive = ESMin(encryption.context->getPushMaxSizeIncoming(), encrypted.size());
+		if (sizeToReceive == 0)
+			break;
+
+		const int32_t receivedSize = Sockets::receiveAvailable(s, encrypted.data(), sizeToReceive);
+		if (receivedSize > 0)
+		{
+			encryption.context->pushEncryptedIncoming(encrypted.data(), receivedSize);
+			updateBuffersTLS(recvBuffer, sendBuffer, terminate); // lets the encryption library accept more data
+			didRecv = true;
+		}
+		else if (receivedSize == 0)
+		{
+			terminate = true;
+			ESLog::es_detail("Connection terminating: closed by peer");
+		}
+		else
+		{
+			if (not Sockets::lastErrorWouldBlock())
+			{
+				terminate = true;
+				ESLog::es_detail("Connection terminating: attempt to receive returned socket error");
+			}
+			break;
+		}
+	}
+	return didRecv;
+}
+
+// completion mode: data the event loop has already received from the socket
+bool StreamThread::loopDeliverReceived(const char* data, size_t size)
+{
+	bool terminate = forceTerminate;
+	if (not encryption.enabled())
+	{
+		if (not recvBuffer.write(data, size))
+		{
+			terminate = true; // end the connection if the application is not consuming received data
+			ESLog::es_detail("Connection terminating: received data too large");
+		}
+	}
+	else
+	{
+		pendingIncoming.append(data, size);
+		feedIncomingTLS(terminate);
+	}
+
+	if (terminate)
+		streamConnected = false;
+	else
+		lastComTimer.start();
+	notifyActivity();
+	return not terminate;
+}
+
+// completion mode: copies up to maxSize bytes of outgoing (encrypted if TLS) data, the event loop sends it from its own buffer
+size_t StreamThread::loopTakeOutgoing(char* dst, size_t maxSize)
+{
+	if (not encryption.enabled())
+	{
+		size_t size = sendBuffer.read(dst, maxSize);
+		if (size == maxSize or not sendQueueUsed.load(std::memory_order_acquire))
+		{
+			checkWritable();
+			return size;
+		}
+		auto queueLock = Lock(sendQueueMutex);
+		size += sendBuffer.read(dst + size, maxSize - size); // data queued to the buffer since it was read is ahead of the segments
+		while (size < maxSize and not sendQueue.empty())
+		{
+			const size_t copySize = sendQueue.copyFront(dst + size, maxSize - size);
+			if (copySize == 0)
+			{
+				ESLog::es_detail("Connection terminating: failed to read file being sent");
+				streamConnected = false;
+				break;
+			}
+			sendQueue.consume(copySize);
+			size += copySize;
+		}
+		sendQueueUsed.store(not sendQueue.empty(), std::memory_order_release);
+		checkWritable();
+		return size;
+	}
+
+	bool terminate = false;
+	feedIncomingTLS(terminate); // the encryption library may have room for received data again
+	updateBuffersTLS(recvBuffer, sendBuffer, terminate);
+	size_t size = 0;
+	while (size < maxSize)
+	{
+		if (pendingEncrypted.empty() and not encryption.context->getEncryptedOutgoing(pendingEncrypted))
+			break;
+		const size_t copySize = ESMin(pendingEncrypted.size(), maxSize - size);
+		memcpy(dst + size, pendingEncrypted.data(), copySize);
+		pendingEncrypted.erase(0, copySize);
+		size += copySize;
+	}
+	if (terminate)
+		streamConnected = false;
+	checkWritable();
+	return size;
+}
+
+void StreamThread::loopSendCompleted()
+{
+	lastComTimer.start();
+	notifyActivity();
+}
+
+// completion mode: pushes received encrypted data into the encryption library, as much as it can accept
+void StreamThread::feedIncomingTLS(bool& terminate)
+{
+	assert(encryption.enabled());
+	size_t fedSize = 0;
+	while (not terminate and fedSize < pendingIncoming.size() and encryption.context->canPushIncoming())
+	{
+		const size_t sizeToPush = ESMin(encryption.context->getPushMaxSizeIncoming(), pendingIncoming.size() - fedSize);
+		if (sizeToPush == 0)
+			break;
+		const size_t pushedSize = encryption.context->pushEncryptedIncoming(pendingIncoming.data() + fedSize, sizeToPush);
+		if (pushedSize == 0)
+			break;
+		fedSize += pushedSize;
+		updateBuffersTLS(recvBuffer, sendBuffer, terminate); // lets the encryption library accept more data
+	}
+	pendingIncoming.erase(0, fedSize);
+	if (pendingIncoming.size() > 5e7)
+	{
+		terminate = true;
+		ESLog::es_detail("Connection terminating: received data too large");
+	}
+}
+
 // public: must be synchronized
 
 bool StreamThread::queueSend(std::string_view data)
@@ -291,36 +868,115 @@ bool StreamThread::queueSend(std::string_view data)
 	if (data.size() == 0)
 		return false;
 
-	Lock l;
-	auto* buf = sendBuffer.getBufferForWrite(l, data.size());
-	if (buf)
 	{
-		memcpy(buf, data.data(), data.size());
-		sendBuffer.written(data.size());
+		auto queueLock = Lock(sendQueueMutex);
+		queueSendLocked(data);
+	}
+	notifyEventLoop();
+	return true;
+}
+
+size_t StreamThread::queueSendPartial(std::string_view data)
+{
+	size_t accepted = 0;
+	{
+		auto queueLock = Lock(sendQueueMutex);
+		const size_t pending = sendBuffer.size() + sendQueue.sizeBytes();
+		const size_t highWatermark = settings->sendHighWatermark;
+		accepted = ESMin((pending < highWatermark) ? highWatermark - pending : 0, data.size());
+		if (accepted > 0)
+			queueSendLocked(data.substr(0, accepted));
+		if (pending + accepted >= highWatermark)
+			sendBlocked = true; // before the servicing thread is woken, so it reports the stream writable once drained
+	}
+	notifyEventLoop();
+	return accepted;
+}
+
+void StreamThread::queueSendLocked(std::string_view data)
+{
+	// must not overtake segments queued earlier, data the full buffer cannot take is queued as a segment of its own
+	if (not sendQueue.empty() or not sendBuffer.write(data.data(), data.size()))
+	{
+		sendQueue.push(SendSegment::fromString(std::string(data)));
+		sendQueueUsed.store(true, std::memory_order_release);
+	}
+}
+
+bool StreamThread::receiveAllowed()
+{
+	const size_t buffered = recvBuffer.size();
+	if (receivePaused)
+	{
+		if (buffered > settings->receiveLowWatermark)
+			return false;
+		receivePaused = false;
+		ESLog::es_detail("Connection resumed receiving");
 		return true;
 	}
+	if (buffered < settings->receiveHighWatermark)
+		return true;
+	receivePaused = true; // resumed by the application taking the received data, see getReceiveBuffer
+	ESLog::es_detail(ESLog::FormatStr() << "Connection paused receiving, " << buffered << " bytes not taken by the application");
 	return false;
 }
 
+void StreamThread::checkWritable()
+{
+	if (not sendBlocked or getSendPendingSize() > settings->sendLowWatermark)
+		return;
+	if (not sendBlocked.exchange(false))
+		return;
+	std::lock_guard<std::mutex> lock(activityMutex);
+	if (writableCallback)
+		writableCallback();
+}
+
+void StreamThread::setWritableCallback(std::function<void()> callback)
+{
+	std::lock_guard<std::mutex> lock(activityMutex);
+	writableCallback = std::move(callback);
+}
+
+bool StreamThread::queueSendSegments(std::vector<SendSegment> segments)
+{
+	{
+		auto queueLock = Lock(sendQueueMutex);
+		for (SendSegment& segment : segments)
+			sendQueue.push(std::move(segment));
+		sendQueueUsed.store(not sendQueue.empty(), std::memory_order_release);
+	}
+	notifyEventLoop();
+	return true;
+}
+
 // public: must be synchronized
 void StreamThread::getReceiveBuffer(std::string& data) 
 {
-	Lock l;
-	size_t readable = 0;
-	auto* buf = recvBuffer.getBufferForRead(l, readable);
-	if (buf and readable)
+	const size_t readable = recvBuffer.size();
+	if (readable)
 	{
-		data = std::string(buf, readable);
-		recvBuffer.read(readable);
+		data.resize(readable);
+		data.resize(recvBuffer.read(data.data(), readable));
 	}
+	// the servicing thread resumes reading when it is next woken, the socket has no new readiness to report meanwhile
+	if (receivePaused)
+		notifyEventLoop();
 }
 
 // public
 size_t StreamThread::getReceiveDataSize() const
 {
-	Lock l;
-	const size_t available = recvBuffer.peekReadSize(l);
-	return available;
+	return recvBuffer.size();
+}
+
+// public
+size_t StreamThread::getSendPendingSize() const
+{
+	if (not sendQueueUsed.load(std::memory_order_acquire))
+		return sendBuffer.size();
+	auto queueLock = Lock(sendQueueMutex);
+	return sendBuffer.size() + sendQueue.sizeBytes();
 }
 
 void StreamEncryptionState::init(StreamEncryptionMode encryptMode)
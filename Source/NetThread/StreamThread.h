@@ -2,8 +2,11 @@
 #pragma once
 #include "Sockets/Sockets.h"
 #include "NetThread/NetThreadSync.h"
+#include "NetThread/SendQueue.h"
+#include "NetThread/SegmentBuffer.h"
 #include <thread>
 #include <chrono>
+#include <functional>
 
 #ifndef _Acquires_lock_()
 #define _Acquires_lock_()
@@ -26,6 +29,11 @@ struct StreamEncryptionState
 };
 
 class NetAgentSettings;
+class EventLoopThread;
+class Resolver;
+
+// largest part of a file sent with one call, so a blocking stream thread also gets to receive while sending a large file
+constexpr size_t ES_SENDFILE_CHUNK_MAX = 4 * 1024 * 1024;
 
 // TCP send/receive op thread class
 class StreamThread
@@ -34,23 +42,61 @@ public:
     using Lock = Sockets::Lock; // syntactic sugar
     StreamThread(size_t sendBufferSize, size_t receiveBufferSize, StreamEncryptionMode encryptMode);
     ~StreamThread();
-	// client
-    void start(std::string_view hostname_, std::string_view port_);
+	// client, the hostname is resolved through the resolver if provided
+	// with an event loop the thread only connects, once connected the stream is handed to the event loop and the thread exits
+    void start(std::string_view hostname_, std::string_view port_, Resolver* resolver_ = nullptr, EventLoopThread* loop = nullptr);
 	// server
     void start(SOCKET socket_);
+	// server, the stream is serviced by a shared event loop instead of a dedicated thread
+    void start(SOCKET socket_, EventLoopThread* loop);
 	void updateSettings(const std::shared_ptr<NetAgentSettings>& settingsNew);
     
     bool isStreamConnected() const { return streamConnected; };
     bool isFailed() const { return connectionFailure; }
+    bool isConnecting() const { return connecting; } // client: still resolving or connecting
 
-    // thread-safely copies to send buffer, returns false if buffer still has unsent data
+    // thread-safely copies to send buffer, all of the data is queued however much is already pending, returns false if empty
     bool queueSend(std::string_view data);
+    // thread-safely copies as much of the data as fits below the send high watermark, returns the number of bytes queued
+    // once data is refused the stream is not writable until the pending data drains below the send low watermark
+    size_t queueSendPartial(std::string_view data);
+    bool isWritable() const { return not sendBlocked; }
+    // thread-safely queues segments to be sent in order after previously queued data, their storage is referenced instead of copied
+    bool queueSendSegments(std::vector<SendSegment> segments);
 
+    // takes all received data, must not be called from two threads at once
     void getReceiveBuffer(std::string& data);
 	size_t getReceiveDataSize() const;
+	// queued data not yet handed to the socket, or to the encryption library when encrypted
+	size_t getSendPendingSize() const;
+
+    // forces the stream thread to shut down, an event loop servicing the stream is woken to drop it
+    void stop() { forceTerminate = true; notifyEventLoop(); }
+
+	// threadsafe, called by the thread servicing the stream after data was received or sent, and once the stream connects or ends
+	// the callback must return quickly and must not call into the stream, nullptr removes it
+	void setActivityCallback(std::function<void()> callback);
+	// threadsafe, called by the thread servicing the stream once it is writable again after queueSendPartial refused data
+	// the callback must return quickly and must not call into the stream, nullptr removes it
+	void setWritableCallback(std::function<void()> callback);
 
-    // forces the stream thread to shut down
-    void stop() { forceTerminate = true; }
+	// event loop mode: performs all I/O that is possible without blocking, returns false once the stream has terminated
+	bool pumpEvents();
+	// event loop mode: returns false once the stream was stopped or has ended
+	bool checkRunning();
+	// event loop mode: checks for communication timeouts, returns false once the stream has terminated
+	// otherwise outputs the time left until the stream times out if nothing is sent or received meanwhile
+	bool checkTimeouts(double& idleRemainingMsOut);
+	// event loop mode: the socket reported an error
+	void closeFromEventLoop();
+	// zerocopy completions are reported through the socket error queue, which also raises socket error events
+	bool usesZerocopy() const { return zerocopyEnabled; }
+	// completion mode: the event loop performs the socket I/O and hands data to and from the stream
+	bool loopDeliverReceived(const char* data, size_t size);
+	size_t loopTakeOutgoing(char* dst, size_t maxSize);
+	void loopSendCompleted();
+	// servicing thread: whether to read more from the socket, false while the application is behind on taking received data
+	bool receiveAllowed();
 
 protected:
     void threadMain();
@@ -58,20 +104,61 @@ protected:
     std::atomic<bool> streamConnected = false;
     std::atomic<bool> connectionFailure = false;
     std::atomic<bool> forceTerminate = false;
+    std::atomic<bool> connecting = false;
 
     Sockets::MutexSocket socket;
-	NetBufferAdvanced recvBuffer, sendBuffer;
+	// the servicing thread produces into the receive buffer and consumes the send buffer, neither side locks the buffers
+	SegmentBuffer recvBuffer, sendBuffer;
+	// segments are sent after the send buffer, once segments are queued further data is queued behind them to keep the order
+	SendQueue sendQueue;
+	mutable std::recursive_mutex sendQueueMutex; // serializes the threads queueing data, and guards sendQueue
+	std::atomic<bool> sendQueueUsed = false; // set while sendQueue holds segments, until then sending needs no lock
     std::string hostname, port;
+	Resolver* resolver = nullptr;
+	bool connectToHost(SOCKET& socketOut, int timeoutMs);
 	Timer lastComTimer;
 	std::shared_ptr<NetAgentSettings> settings = nullptr;
 
 	StreamEncryptionState encryption{};
 
+	// set by the client thread once connected, while other threads may already be queueing data
+	std::atomic<EventLoopThread*> eventLoop = nullptr;
+	uint64_t eventLoopKey = 0; // written before eventLoop
+	EventLoopThread* connectLoop = nullptr; // client: the event loop to hand the stream to once connected
+	bool attachToEventLoop(SOCKET s, EventLoopThread* loop);
+	void notifyEventLoop();
+	void notifyActivity();
+	std::mutex activityMutex;
+	std::function<void()> activityCallback = nullptr;
+	std::atomic<bool> activityWatched = false; // lets the I/O paths skip the mutex while nobody waits for activity
+	std::function<void()> writableCallback = nullptr; // guarded by activityMutex
+	std::atomic<bool> sendBlocked = false; // set once the send high watermark was reached, until below the low watermark
+	std::atomic<bool> receivePaused = false; // set once the receive high watermark was reached, until below the low watermark
+	void checkWritable(); // servicing thread: after sending, reports the stream writable once drained below the low watermark
+	void queueSendLocked(std::string_view data); // sendQueueMutex must be held
+	std::string pendingEncrypted{}; // encrypted data the socket was not ready to accept
+	std::atomic<bool> zerocopyEnabled = false;
+	bool kernelTlsSend = false; // outgoing records are encrypted by the kernel, data is sent as on an unencrypted stream
+	bool kernelTlsAttempted = false;
+	uint32_t zerocopyNextSendId = 0; // the kernel numbers successful zerocopy sends of a socket in the same order
+	std::string pendingIncoming{}; // completion mode: received encrypted data the encryption library was not ready to accept
+
+	int64_t sendGathered(SOCKET s);
+	int64_t sendFileSegment(SOCKET s);
+	void initZerocopy(SOCKET s);
+	void enableKernelTls(SOCKET s);
+	void releaseZerocopySends(SOCKET s);
 	bool threadSendData(Timer& lastComTimer, bool& terminate);
 	bool threadSendDataTLS(Timer& lastComTimer, bool& terminate);
 	bool threadReceiveData(Timer& lastComTimer, bool& terminate);
 	bool threadReceiveDataTLS(Timer& lastComTimer, bool& terminate);
-	void updateBuffersTLS(NetBufferAdvanced& recvBuffer, NetBufferAdvanced& sendBuffer, bool& terminate);
+	void updateBuffersTLS(SegmentBuffer& recvBuffer, SegmentBuffer& sendBuffer, bool& terminate);
+
+	bool loopSendData(SOCKET s, bool& terminate);
+	bool sendDataTLS(SOCKET s, bool& terminate);
+	bool loopReceiveData(SOCKET s, bool& terminate);
+	bool loopReceiveDataTLS(SOCKET s, bool& terminate);
+	void feedIncomingTLS(bool& terminate);
 };
 
 
@@ -0,0 +1,114 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#include "ThreadPlacement.h"
+#include <string>
+#include <filesystem>
+#include <system_error>
+
+#ifdef __linux__
+	#include <pthread.h>
+	#include <sched.h>
+	#include <unistd.h>
+	#include <sys/syscall.h>
+	#include <linux/mempolicy.h>
+#endif
+
+namespace ThreadPlacement
+{
+#ifdef __linux__
+    namespace
+    {
+        constexpr unsigned long ES_NODE_MASK_BITS = 16 * 8 * sizeof(unsigned long);
+
+        thread_local int preferredNode = -1;
+
+        // the kernel reads one bit less than maxnode, glibc does not wrap these calls, libnuma would only be needed for this
+        bool setMemoryPolicy(int mode, const unsigned long* nodes)
+        {
+            return syscall(SYS_set_mempolicy, mode, nodes, nodes ? ES_NODE_MASK_BITS + 1 : 0) == 0;
+        }
+    }
+
+    bool pinCurrentThread(const std::vector<int>& cores)
+    {
+        if (cores.empty())
+            return false;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int core : cores)
+        {
+            if (core < 0 or core >= CPU_SETSIZE)
+                return false;
+            CPU_SET(core, &set);
+        }
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+    }
+
+    int numaNodeOfCore(int core)
+    {
+        if (core < 0)
+            return -1;
+        // each core directory links to its node as "node<n>"
+        std::error_code error;
+        const std::filesystem::path coreDir = "/sys/devices/system/cpu/cpu" + std::to_string(core);
+        for (const auto& entry : std::filesystem::directory_iterator(coreDir, error))
+        {
+            const std::string name = entry.path().filename().string();
+            if (name.size() > 4 and name.compare(0, 4, "node") == 0 and name.find_first_not_of("0123456789", 4) == std::string::npos)
+                return std::stoi(name.substr(4));
+        }
+        return -1;
+    }
+
+    bool preferNumaNode(int node)
+    {
+        if (node < 0)
+        {
+            if (not setMemoryPolicy(MPOL_DEFAULT, nullptr))
+                return false;
+            preferredNode = -1;
+            return true;
+        }
+        if ((unsigned long)node >= ES_NODE_MASK_BITS)
+            return false;
+        unsigned long nodes[16]{};
+        nodes[node / (8 * sizeof(unsigned long))] = 1ul << (node % (8 * sizeof(unsigned long)));
+        if (not setMemoryPolicy(MPOL_PREFERRED, nodes))
+            return false;
+        preferredNode = node;
+        return true;
+    }
+
+    int preferredNumaNode()
+    {
+        return preferredNode;
+    }
+
+    ScopedNumaPreference::ScopedNumaPreference(int node)
+    {
+        if (node < 0)
+            return;
+        if (syscall(SYS_get_mempolicy, &previousMode, previousNodes, ES_NODE_MASK_BITS + 1, nullptr, 0) != 0)
+            return;
+        previousNode = preferredNode;
+        applied = preferNumaNode(node);
+    }
+
+    ScopedNumaPreference::~ScopedNumaPreference()
+    {
+        if (applied and setMemoryPolicy(previousMode, (previousMode == MPOL_DEFAULT) ? nullptr : previousNodes))
+            preferredNode = previousNode;
+    }
+#else
+    bool pinCurrentThread(const std::vector<int>& /*cores*/) { return false; }
+    int numaNodeOfCore(int /*core*/) { return -1; }
+    bool preferNumaNode(int /*node*/) { return false; }
+    int preferredNumaNode() { return -1; }
+    ScopedNumaPreference::ScopedNumaPreference(int /*node*/) {}
+    ScopedNumaPreference::~ScopedNumaPreference() {}
+#endif
+
+    bool pinCurrentThread(int core)
+    {
+        return pinCurrentThread(std::vector<int>{ core });
+    }
+}
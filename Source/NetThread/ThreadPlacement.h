@@ -0,0 +1,39 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#pragma once
+#include <vector>
+
+// placement of threads on cores and of their memory on NUMA nodes, so a connection's hot path stays on one socket of a
+// multi-socket machine instead of pulling cache lines and memory across the interconnect (Linux only, no effect elsewhere)
+namespace ThreadPlacement
+{
+    // restricts the calling thread to the cores, an empty list leaves placement to the OS, returns false if not applied
+    bool pinCurrentThread(const std::vector<int>& cores);
+    bool pinCurrentThread(int core);
+
+    // the NUMA node the core belongs to, -1 if unknown
+    int numaNodeOfCore(int core);
+
+    // pages the calling thread touches for the first time from now on are placed on the node while it has free memory,
+    // a negative node restores the default of placing them on the node of the core the thread runs on
+    bool preferNumaNode(int node);
+    // the node last preferred for the calling thread, -1 if none, for allocators that keep memory per node themselves
+    int preferredNumaNode();
+
+    // prefers the node for the lifetime of the object, allocations made meanwhile are local to whichever thread the node is
+    // preferred for, such as the worker that will service a connection, only memory that is fresh from the kernel moves,
+    // the allocator reuses pages it already owns wherever they are
+    class ScopedNumaPreference
+    {
+    public:
+        explicit ScopedNumaPreference(int node);
+        ~ScopedNumaPreference();
+        ScopedNumaPreference(const ScopedNumaPreference&) = delete;
+        ScopedNumaPreference& operator=(const ScopedNumaPreference&) = delete;
+
+    private:
+        bool applied = false;
+        int previousMode = 0;
+        int previousNode = -1;
+        unsigned long previousNodes[16]{}; // up to 1024 nodes
+    };
+}
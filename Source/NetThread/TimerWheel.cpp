@@ -0,0 +1,92 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#include "TimerWheel.h"
+#include <cmath>
+#include <algorithm>
+#include <cassert>
+
+void WheelTimer::cancel()
+{
+    if (wheel)
+        wheel->unlink(*this);
+}
+
+TimerWheel::TimerWheel(uint32_t tickMs)
+    : startTime{ std::chrono::steady_clock::now() }, tickMs{ (tickMs > 0) ? tickMs : 1 }
+{
+}
+
+TimerWheel::~TimerWheel()
+{
+    // timers outliving the wheel are left disarmed
+    for (auto& level : slots)
+    {
+        for (WheelTimer* head : level)
+        {
+            for (WheelTimer* timer = head; timer; timer = timer->next)
+                timer->wheel = nullptr;
+        }
+    }
+}
+
+void TimerWheel::arm(WheelTimer& timer, double delayMs)
+{
+    timer.cancel();
+    constexpr uint64_t spanTicks = 1ull << (ES_WHEEL_LEVELS * ES_WHEEL_SLOT_BITS);
+    const double delayTicks = std::clamp(std::ceil(delayMs / tickMs), 0.0, (double)spanTicks);
+    // the wheel may lag behind the clock until it is next advanced, the delay counts from now rather than from the last advance
+    const uint64_t lag = ticksElapsed() - currentTick;
+    timer.deadlineTick = currentTick + std::clamp((uint64_t)delayTicks + lag, (uint64_t)1, spanTicks - 1);
+    insert(timer);
+}
+
+void TimerWheel::insert(WheelTimer& timer)
+{
+    assert(not timer.wheel);
+    const uint64_t delta = (timer.deadlineTick > currentTick) ? timer.deadlineTick - currentTick : 0;
+    uint32_t level = 0;
+    while (level + 1 < ES_WHEEL_LEVELS and delta >= (1ull << ((level + 1) * ES_WHEEL_SLOT_BITS)))
+        level++;
+    // a timer already due is placed in the slot of the current tick, which is expired next
+    const uint64_t tick = (delta > 0) ? timer.deadlineTick : currentTick;
+    timer.level = level;
+    timer.slot = (uint32_t)((tick >> (level * ES_WHEEL_SLOT_BITS)) & (ES_WHEEL_SLOTS - 1));
+
+    WheelTimer*& head = slots[level][timer.slot];
+    timer.prev = nullptr;
+    timer.next = head;
+    if (head)
+        head->prev = &timer;
+    head = &timer;
+    timer.wheel = this;
+    armedCount++;
+}
+
+void TimerWheel::unlink(WheelTimer& timer)
+{
+    assert(timer.wheel == this);
+    if (timer.prev)
+        timer.prev->next = timer.next;
+    else
+        slots[timer.level][timer.slot] = timer.next;
+    if (timer.next)
+        timer.next->prev = timer.prev;
+    timer.prev = timer.next = nullptr;
+    timer.wheel = nullptr;
+    armedCount--;
+}
+
+void TimerWheel::cascade(uint32_t level)
+{
+    WheelTimer*& head = slots[level][(currentTick >> (level * ES_WHEEL_SLOT_BITS)) & (ES_WHEEL_SLOTS - 1)];
+    while (WheelTimer* timer = head)
+    {
+        unlink(*timer);
+        insert(*timer); // due within the span of this slot, so it lands on a lower level
+    }
+}
+
+uint64_t TimerWheel::ticksElapsed() const
+{
+    const auto elapsed = std::chrono::steady_clock::now() - startTime;
+    return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() / tickMs;
+}
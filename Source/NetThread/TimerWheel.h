@@ -0,0 +1,99 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+class TimerWheel;
+
+// a deadline on a TimerWheel, owned by the caller and linked into the wheel while armed, destroying it cancels it
+class WheelTimer
+{
+public:
+    explicit WheelTimer(uint64_t key = 0) : key{ key } {}
+    ~WheelTimer() { cancel(); }
+    WheelTimer(const WheelTimer&) = delete;
+    WheelTimer& operator=(const WheelTimer&) = delete;
+
+    bool isArmed() const { return wheel != nullptr; }
+    void cancel();
+
+    uint64_t key = 0; // identifies what expired to the owner of the wheel
+
+private:
+    friend class TimerWheel;
+    TimerWheel* wheel = nullptr;
+    WheelTimer* prev = nullptr;
+    WheelTimer* next = nullptr;
+    uint64_t deadlineTick = 0;
+    uint32_t level = 0;
+    uint32_t slot = 0;
+};
+
+// hierarchical timing wheel, arming, cancelling and expiring a timer are constant time however many timers are armed
+// each level has 64 slots, a slot of level n spans 64^n ticks, timers move down a level each time the level above turns over
+// so the thread advancing the wheel only touches the timers that are due, and the empty slots it passes, not threadsafe
+class TimerWheel
+{
+public:
+    explicit TimerWheel(uint32_t tickMs);
+    ~TimerWheel();
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // (re)arms the timer to expire once delayMs has passed, rounded up to whole ticks, delays beyond the wheel's span are clamped
+    void arm(WheelTimer& timer, double delayMs);
+    size_t numArmed() const { return armedCount; }
+
+    // expires every timer that is due, onExpired(WheelTimer&) is called with the timer already disarmed, so it may rearm or
+    // destroy it, as well as arm or cancel other timers, returns the number of timers expired
+    template<typename Function>
+    size_t advance(Function&& onExpired);
+
+private:
+    friend class WheelTimer;
+    static constexpr uint32_t ES_WHEEL_SLOT_BITS = 6;
+    static constexpr uint32_t ES_WHEEL_SLOTS = 1u << ES_WHEEL_SLOT_BITS;
+    static constexpr uint32_t ES_WHEEL_LEVELS = 4; // 64^4 ticks, about 19 days at 100ms ticks
+
+    void insert(WheelTimer& timer);
+    void unlink(WheelTimer& timer);
+    void cascade(uint32_t level);
+    uint64_t ticksElapsed() const;
+
+    std::array<std::array<WheelTimer*, ES_WHEEL_SLOTS>, ES_WHEEL_LEVELS> slots{};
+    const std::chrono::steady_clock::time_point startTime;
+    const uint32_t tickMs;
+    uint64_t currentTick = 0; // every timer due at or before this tick has expired
+    size_t armedCount = 0;
+};
+
+template<typename Function>
+size_t TimerWheel::advance(Function&& onExpired)
+{
+    const uint64_t targetTick = ticksElapsed();
+    if (armedCount == 0)
+        currentTick = targetTick; // nothing to pass on the way
+    size_t numExpired = 0;
+    while (currentTick < targetTick)
+    {
+        currentTick++;
+        // a level turns over when every level below it has wrapped around, its slot for the new span moves down a level
+        // the highest level goes first, its timers may land in the slot of a lower level which is turning over on the same tick
+        uint32_t turnedOver = 0;
+        while (turnedOver + 1 < ES_WHEEL_LEVELS and (currentTick & ((1ull << ((turnedOver + 1) * ES_WHEEL_SLOT_BITS)) - 1)) == 0)
+            turnedOver++;
+        for (uint32_t level = turnedOver; level > 0; level--)
+            cascade(level);
+        // timers armed by the callbacks are due on later ticks, they never land in the slot being expired
+        WheelTimer*& head = slots[0][currentTick & (ES_WHEEL_SLOTS - 1)];
+        while (WheelTimer* timer = head)
+        {
+            unlink(*timer);
+            numExpired++;
+            onExpired(*timer);
+        }
+    }
+    return numExpired;
+}
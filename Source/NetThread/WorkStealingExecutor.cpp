@@ -0,0 +1,105 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#include "WorkStealingExecutor.h"
+#include "NetThreadSync.h"
+#include "Sockets/PlatformMacros.h"
+
+namespace
+{
+    // the executor and queue index of the pool thread running on this thread, tasks it submits go to its own queue
+    thread_local const WorkStealingExecutor* currentExecutor = nullptr;
+    thread_local size_t currentWorker = 0;
+}
+
+WorkStealingExecutor::WorkStealingExecutor(size_t numThreads)
+{
+    const size_t count = (numThreads > 0) ? numThreads : ESMax((size_t)std::thread::hardware_concurrency(), (size_t)1);
+    for (size_t i = 0; i < count; i++)
+        workers.push_back(std::make_unique<Worker>());
+    for (size_t i = 0; i < count; i++)
+        threads.emplace_back([this, i] { this->threadMain(i); });
+}
+
+WorkStealingExecutor::~WorkStealingExecutor()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        terminate = true;
+    }
+    taskQueued.notify_all();
+    for (auto& thread : threads)
+        thread.join();
+}
+
+void WorkStealingExecutor::submit(Task task)
+{
+    const size_t index = (currentExecutor == this) ? currentWorker
+                                                   : nextWorker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+    numPending.fetch_add(1, std::memory_order_seq_cst); // counted before it is queued, so taking it never underflows the count
+    {
+        std::lock_guard<std::mutex> lock(workers[index]->mutex);
+        workers[index]->tasks.push_back(std::move(task));
+    }
+    // pairs with waitForTask, either the sleeper sees the task or the task sees the sleeper
+    if (numSleeping.load(std::memory_order_seq_cst) > 0)
+    {
+        { std::lock_guard<std::mutex> lock(sleepMutex); }
+        taskQueued.notify_one();
+    }
+}
+
+void WorkStealingExecutor::threadMain(size_t index)
+{
+	WIN_SET_THREAD_NAME(L"Task Executor Thread");
+    currentExecutor = this;
+    currentWorker = index;
+    Task task;
+    while (true)
+    {
+        if (takeTask(index, task))
+        {
+            task();
+            task = nullptr; // release what the task captured before sleeping
+            continue;
+        }
+        if (terminate)
+            return; // every queue was empty, and no more tasks are submitted during destruction
+        waitForTask();
+    }
+}
+
+bool WorkStealingExecutor::takeTask(size_t index, Task& taskOut)
+{
+    if (numPending.load(std::memory_order_relaxed) == 0)
+        return false;
+    {
+        Worker& own = *workers[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (not own.tasks.empty())
+        {
+            taskOut = std::move(own.tasks.back()); // the most recently queued task is the most likely to be cache-hot
+            own.tasks.pop_back();
+            numPending.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    for (size_t i = 1; i < workers.size(); i++)
+    {
+        Worker& victim = *workers[(index + i) % workers.size()];
+        std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+        if (not lock.owns_lock() or victim.tasks.empty())
+            continue; // a busy queue is skipped rather than waited on, it is retried on the next pass
+        taskOut = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        numPending.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+void WorkStealingExecutor::waitForTask()
+{
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    numSleeping.fetch_add(1, std::memory_order_seq_cst);
+    taskQueued.wait(lock, [this] { return terminate or numPending.load(std::memory_order_seq_cst) > 0; });
+    numSleeping.fetch_sub(1, std::memory_order_relaxed);
+}
@@ -0,0 +1,49 @@
+// Copyright 2025 Simon Liimatainen, Europa Software. All rights reserved.
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <deque>
+#include <vector>
+#include <memory>
+
+// fixed pool of threads running submitted tasks, each thread has its own task queue and steals from the others once it runs dry
+// tasks submitted from outside the pool are spread between the queues, tasks submitted from a pool thread go to its own queue
+class WorkStealingExecutor
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit WorkStealingExecutor(size_t numThreads); // 0 uses one thread per hardware thread
+    ~WorkStealingExecutor(); // runs the tasks still queued before joining the threads
+    WorkStealingExecutor(const WorkStealingExecutor&) = delete;
+    WorkStealingExecutor& operator=(const WorkStealingExecutor&) = delete;
+
+    // threadsafe, tasks run in no particular order and may run concurrently with each other
+    void submit(Task task);
+
+    size_t numThreads() const { return threads.size(); }
+    size_t numQueued() const { return numPending.load(std::memory_order_relaxed); }
+
+protected:
+    struct alignas(64) Worker
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks; // the owner takes from the back, thieves take from the front
+    };
+
+    void threadMain(size_t index);
+    bool takeTask(size_t index, Task& taskOut); // own queue first, then steals
+    void waitForTask();
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    std::atomic<size_t> numPending = 0; // tasks queued but not yet taken
+    std::atomic<size_t> numSleeping = 0;
+    std::atomic<size_t> nextWorker = 0; // round robin for submissions from outside the pool
+    std::atomic<bool> terminate = false;
+    std::mutex sleepMutex;
+    std::condition_variable taskQueued;
+};
@@ -3,6 +3,10 @@
 // The example functions are defined in these files
 #include "Examples/TcpChatExample.h"
 #include "Examples/HttpServerExample.h"
+#include "Examples/CoroutineEchoExample.h"
+#include "Examples/BufferBenchmark.h"
+#include "Examples/ConnectionRegistryBenchmark.h"
+#include "Examples/BufferPoolBenchmark.h"
 
 #include <iostream>
 #include <string>
@@ -14,5 +18,13 @@ int main()
 	
 	//return tcpChatExample();
 
+	//return coroutineEchoExample();
+
+	//return bufferBenchmark();
+
+	//return connectionRegistryBenchmark();
+
+	//return bufferPoolBenchmark();
+
 	return httpServerExample("C:/YourWebrootPathHere");
 }
\ No newline at end of file
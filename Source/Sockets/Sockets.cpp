@@ -2,10 +2,44 @@
 #include "Sockets.h"
 
 #include <cassert>
+#include <cerrno>
 #include <cstring>
 #include <string>
 #include <thread>
 #include <chrono>
+#include <array>
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+
+#ifndef _WIN32
+	#include <sys/uio.h>
+	#include <poll.h>
+	#include <netinet/tcp.h>
+#endif
+#ifdef __linux__
+	#include <sys/sendfile.h>
+	#include <netinet/in.h>
+	#include <netinet/udp.h>
+	#include <linux/errqueue.h>
+#endif
+#if defined(__linux__) and __has_include(<linux/tls.h>)
+	#include <linux/tls.h>
+	#define ES_KERNEL_TLS
+	#ifndef SOL_TLS
+		#define SOL_TLS 282 // older libc headers
+	#endif
+	#ifndef TCP_ULP
+		#define TCP_ULP 31
+	#endif
+#endif
+#if defined(__linux__) and not defined(UDP_SEGMENT)
+	#define UDP_SEGMENT 103 // older libc headers
+#endif
+#if defined(__linux__) and not defined(UDP_GRO)
+	#define UDP_GRO 104
+#endif
 
 namespace Sockets
 {
@@ -33,6 +67,158 @@ namespace Sockets
 		return count;
 	}
 
+    SocketTuning SocketTuning::fromProfile(SocketProfile profile)
+    {
+        switch (profile)
+        {
+        case SocketProfile::Latency:
+            return SocketTuning{ .noDelay = true, .deferAcceptSec = 1, .fastOpenQueue = 256, .busyPollUs = 50 };
+        case SocketProfile::Throughput:
+            return SocketTuning{ .noDelay = true, .deferAcceptSec = 1, .fastOpenQueue = 256,
+                                 .sendBufferSize = 1024 * 1024, .receiveBufferSize = 1024 * 1024 };
+        case SocketProfile::Bulk:
+            return SocketTuning{ .sendBufferSize = 4 * 1024 * 1024, .receiveBufferSize = 4 * 1024 * 1024 };
+        default:
+            return SocketTuning{};
+        }
+    }
+
+    bool SocketTuning::isDefault() const
+    {
+        return not noDelay and deferAcceptSec == 0 and fastOpenQueue == 0 and sendBufferSize == 0 and
+               receiveBufferSize == 0 and busyPollUs == 0;
+    }
+
+    bool SocketTuningReport::allApplied() const
+    {
+        return std::all_of(options.begin(), options.end(), [](const Option& option) { return option.applied; });
+    }
+
+    std::string SocketTuningReport::toString() const
+    {
+        if (options.empty())
+            return "system defaults";
+        std::string text;
+        for (const Option& option : options)
+        {
+            text += (text.empty() ? "" : " ") + option.name + "=" + std::to_string(option.requested);
+            if (not option.applied)
+                text += " (failed: " + option.error + ")";
+            else if (option.effective != option.requested)
+                text += " (effective " + std::to_string(option.effective) + ")";
+        }
+        return text;
+    }
+
+    namespace
+    {
+        constexpr int ES_OPTION_UNSUPPORTED = -1;
+        struct TuningOption { const char* name; int level; int option; int value; };
+
+        // the options of the tuning that apply to the role, unsupported options are kept so they show up in the report
+        std::vector<TuningOption> tuningOptions(const SocketTuning& tuning, SocketRole role)
+        {
+            std::vector<TuningOption> options;
+            auto add = [&options](const char* name, int level, int option, int value)
+            {
+                if (value != 0)
+                    options.push_back(TuningOption{ name, level, option, value });
+            };
+            add("TCP_NODELAY", IPPROTO_TCP, TCP_NODELAY, tuning.noDelay ? 1 : 0);
+            add("SO_SNDBUF", SOL_SOCKET, SO_SNDBUF, tuning.sendBufferSize);
+            add("SO_RCVBUF", SOL_SOCKET, SO_RCVBUF, tuning.receiveBufferSize);
+#ifdef SO_BUSY_POLL
+            add("SO_BUSY_POLL", SOL_SOCKET, SO_BUSY_POLL, tuning.busyPollUs);
+#else
+            add("SO_BUSY_POLL", SOL_SOCKET, ES_OPTION_UNSUPPORTED, tuning.busyPollUs);
+#endif
+            if (role == SocketRole::Listen)
+            {
+#ifdef TCP_DEFER_ACCEPT
+                add("TCP_DEFER_ACCEPT", IPPROTO_TCP, TCP_DEFER_ACCEPT, tuning.deferAcceptSec);
+#else
+                add("TCP_DEFER_ACCEPT", IPPROTO_TCP, ES_OPTION_UNSUPPORTED, tuning.deferAcceptSec);
+#endif
+#if defined(TCP_FASTOPEN) and not defined(_WIN32)
+                add("TCP_FASTOPEN", IPPROTO_TCP, TCP_FASTOPEN, tuning.fastOpenQueue);
+#else
+                add("TCP_FASTOPEN", IPPROTO_TCP, ES_OPTION_UNSUPPORTED, tuning.fastOpenQueue);
+#endif
+            }
+            else if (role == SocketRole::Connecting)
+            {
+#ifdef TCP_FASTOPEN_CONNECT
+                add("TCP_FASTOPEN_CONNECT", IPPROTO_TCP, TCP_FASTOPEN_CONNECT, (tuning.fastOpenQueue > 0) ? 1 : 0);
+#else
+                add("TCP_FASTOPEN_CONNECT", IPPROTO_TCP, ES_OPTION_UNSUPPORTED, (tuning.fastOpenQueue > 0) ? 1 : 0);
+#endif
+            }
+            return options;
+        }
+
+        std::string lastErrorString()
+        {
+#ifdef _WIN32
+            return "error " + std::to_string(WSAGetLastError());
+#else
+            return strerror(errno);
+#endif
+        }
+
+        SocketTuningReport tuneSocket(SOCKET s, const SocketTuning& tuning, SocketRole role, bool apply)
+        {
+            SocketTuningReport report{};
+            sockaddr_storage local{};
+            socklen_t localSize = sizeof(local);
+            const bool unixSocket = (getsockname(s, (sockaddr*)&local, &localSize) != SOCKET_ERROR) and local.ss_family == AF_UNIX;
+            for (const TuningOption& option : tuningOptions(tuning, role))
+            {
+                if (unixSocket and option.level == IPPROTO_TCP)
+                    continue; // TCP options have no meaning for unix domain sockets
+                SocketTuningReport::Option& result = report.options.emplace_back();
+                result.name = option.name;
+                result.requested = option.value;
+                if (option.option == ES_OPTION_UNSUPPORTED)
+                {
+                    result.error = "not supported on this platform";
+                    continue;
+                }
+                if (apply and setsockopt(s, option.level, option.option, (const char*)&option.value, sizeof(option.value)) == SOCKET_ERROR)
+                {
+                    result.error = lastErrorString();
+                    continue;
+                }
+                socklen_t valueSize = sizeof(result.effective);
+                if (getsockopt(s, option.level, option.option, (char*)&result.effective, &valueSize) == SOCKET_ERROR)
+                    result.effective = option.value; // write-only option, the set succeeded
+                // the kernel rounds some values (buffer sizes, deferred accept timeouts), any non-zero value means the option is on
+                result.applied = (result.effective != 0);
+                if (not result.applied)
+                    result.error = "reads back as 0";
+            }
+            return report;
+        }
+    }
+
+    SocketTuningReport applySocketTuning(SOCKET s, const SocketTuning& tuning, SocketRole role)
+    {
+        return tuneSocket(s, tuning, role, true);
+    }
+
+    SocketTuningReport readSocketTuning(SOCKET s, const SocketTuning& tuning, SocketRole role)
+    {
+        return tuneSocket(s, tuning, role, false);
+    }
+
+    bool socketTuningInherited()
+    {
+#ifdef __linux__
+        return true;
+#else
+        return false;
+#endif
+    }
+
     bool resolveHostname(const std::string& hostname, bool numericHost, addrinfo*& addrOut, 
                         const std::string& port, bool numericPort, bool listenSocket)
 	{
@@ -40,73 +226,733 @@ namespace Sockets
         memset(&hints, 0, sizeof(hints));
         hints.ai_socktype = SOCK_STREAM; // STREAM, DGRAM, etc.
         hints.ai_protocol = IPPROTO_TCP;
-        hints.ai_family = AF_INET; // IPv4 (AF_INET), IPv6 (AF_INET6), etc.
+        hints.ai_family = listenSocket ? AF_INET : AF_UNSPEC; // IPv4 (AF_INET), IPv6 (AF_INET6), etc.
         hints.ai_flags =  (numericHost ? AI_NUMERICHOST : 0x0)
                         | (numericPort ? AI_NUMERICSERV : 0x0)
-                        | (listenSocket ? AI_PASSIVE : 0x0);
+                        | (listenSocket ? AI_PASSIVE : AI_ADDRCONFIG); // only families the host has addresses for
 
         const char* h = listenSocket ? NULL : hostname.c_str();
         return (getaddrinfo(h, port.c_str(), &hints, &addrOut) == 0);
 	}
 
-	bool connectSocket(addrinfo*& addr, SOCKET& socketOut)
+    namespace
+    {
+        // RFC 8305 section 4: interleave the address families, starting with the family of the address the resolver preferred
+        std::vector<const SocketAddress*> orderConnectCandidates(const std::vector<SocketAddress>& addresses)
+        {
+            std::vector<const SocketAddress*> preferred, other;
+            const int preferredFamily = addresses.empty() ? AF_UNSPEC : addresses.front().family();
+            for (const SocketAddress& address : addresses)
+            {
+                if (address.family() == AF_INET or address.family() == AF_INET6 or address.family() == AF_UNIX)
+                    (address.family() == preferredFamily ? preferred : other).push_back(&address);
+            }
+            std::vector<const SocketAddress*> ordered;
+            for (size_t i = 0; i < preferred.size() or i < other.size(); i++)
+            {
+                if (i < preferred.size())
+                    ordered.push_back(preferred[i]);
+                if (i < other.size())
+                    ordered.push_back(other[i]);
+            }
+            return ordered;
+        }
+
+        bool lastErrorConnectInProgress()
+        {
+#ifdef _WIN32
+            return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+            return errno == EINPROGRESS;
+#endif
+        }
+
+        int pendingSocketError(SOCKET s)
+        {
+            int error = 0;
+            socklen_t errorSize = sizeof(error);
+            if (getsockopt(s, SOL_SOCKET, SO_ERROR, (char*)&error, &errorSize) == SOCKET_ERROR)
+                return -1;
+            return error;
+        }
+
+        void appendAddresses(const addrinfo* addr, std::vector<SocketAddress>& addressesOut)
+        {
+            for (const addrinfo* p = addr; p; p = p->ai_next)
+            {
+                if (p->ai_addrlen > sizeof(sockaddr_storage))
+                    continue;
+                SocketAddress& address = addressesOut.emplace_back();
+                memcpy(&address.storage, p->ai_addr, p->ai_addrlen);
+                address.size = (socklen_t)p->ai_addrlen;
+            }
+        }
+    }
+
+	bool connectSocket(addrinfo*& addr, SOCKET& socketOut, int timeoutMs, const SocketTuning& tuning)
 	{
-        for (addrinfo* p = addr; p; p = p->ai_next)
-        {
-            if (p->ai_family != 2) { continue; }
-            std::cout << "\nAttempting connection to " << getAddrAsString(p);
-            SOCKET s = INVALID_SOCKET;
-            s = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
-            if (s == INVALID_SOCKET) { continue; }
-            bool connected = (connect(s, p->ai_addr, (socklen_t)p->ai_addrlen) != SOCKET_ERROR);
-            if (s == INVALID_SOCKET || !connected) { closeSocket(s); continue; }
-            socketOut = s;
-            return true;
+        std::vector<SocketAddress> addresses;
+        appendAddresses(addr, addresses);
+        return connectSocket(addresses, socketOut, timeoutMs, tuning);
+	}
+
+    bool resolveAddresses(const std::string& hostname, const std::string& port, std::vector<SocketAddress>& addressesOut)
+    {
+        if (isUnixAddress(hostname))
+        {
+            addressesOut.resize(1);
+            return unixSocketAddress(hostname, addressesOut.front());
         }
-        return false;
+        addrinfo* hostAddr = nullptr;
+        if (!resolveHostname(hostname, false, hostAddr, port, true)) { return false; }
+        addressesOut.clear();
+        appendAddresses(hostAddr, addressesOut);
+        freeaddrinfo(hostAddr);
+        return not addressesOut.empty();
+    }
+
+	bool connectSocket(const std::vector<SocketAddress>& addresses, SOCKET& socketOut, int timeoutMs, const SocketTuning& tuning)
+	{
+        using Clock = std::chrono::steady_clock;
+        const std::vector<const SocketAddress*> candidates = orderConnectCandidates(addresses);
+        std::vector<SOCKET> attempts; // non-blocking connects in progress
+        size_t nextCandidate = 0;
+        const auto deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+        auto nextAttemptTime = Clock::now();
+        SOCKET connected = INVALID_SOCKET;
+
+        while (connected == INVALID_SOCKET)
+        {
+            const auto now = Clock::now();
+            if (now >= deadline)
+                break;
+
+            // start the next attempt once the previous one has had its head start, or right away if every attempt has failed
+            if (nextCandidate < candidates.size() and (now >= nextAttemptTime or attempts.empty()))
+            {
+                const SocketAddress* address = candidates[nextCandidate++];
+                nextAttemptTime = now + std::chrono::milliseconds(ES_CONNECT_ATTEMPT_DELAY_MS);
+                SOCKET s = socket(address->family(), SOCK_STREAM, (address->family() == AF_UNIX) ? 0 : IPPROTO_TCP);
+                if (s == INVALID_SOCKET)
+                    continue;
+                setBlocking(s, false);
+                if (not tuning.isDefault())
+                    applySocketTuning(s, tuning, SocketRole::Connecting); // before connecting, so buffer sizes shape the handshake
+                if (connect(s, (const sockaddr*)&address->storage, address->size) != SOCKET_ERROR)
+                    connected = s; // completed immediately, such as on loopback
+                else if (lastErrorConnectInProgress())
+                    attempts.push_back(s);
+                else
+                    closeSocket(s);
+                continue;
+            }
+            if (attempts.empty())
+                break; // every address failed
+
+            // wait for an attempt to finish, at most until the next attempt is due
+            const auto waitUntil = (nextCandidate < candidates.size()) ? std::min(nextAttemptTime, deadline) : deadline;
+            const auto waitMs = std::chrono::ceil<std::chrono::milliseconds>(waitUntil - now).count();
+#ifdef _WIN32
+            std::vector<WSAPOLLFD> fds;
+#else
+            std::vector<pollfd> fds;
+#endif
+            for (SOCKET s : attempts)
+                fds.push_back({ s, POLLOUT, 0 });
+#ifdef _WIN32
+            WSAPoll(fds.data(), (ULONG)fds.size(), (INT)waitMs);
+#else
+            poll(fds.data(), (nfds_t)fds.size(), (int)waitMs);
+#endif
+            for (size_t i = fds.size(); i-- > 0;)
+            {
+                if (fds[i].revents == 0)
+                    continue;
+                if (connected == INVALID_SOCKET and pendingSocketError(attempts[i]) == 0)
+                {
+                    connected = attempts[i];
+                }
+                else
+                {
+                    closeSocket(attempts[i]);
+                    nextAttemptTime = now; // a failed attempt hands over to the next address immediately
+                }
+                attempts.erase(attempts.begin() + i);
+            }
+        }
+
+        for (SOCKET s : attempts)
+            closeSocket(s);
+        if (connected == INVALID_SOCKET)
+            return false;
+        setBlocking(connected, true);
+        socketOut = connected;
+        return true;
 	}
 
-    bool setupStream(const std::string& hostname, const std::string& port, SOCKET& socketOut) 
+    bool setupStream(const std::string& hostname, const std::string& port, SOCKET& socketOut, int timeoutMs, const SocketTuning& tuning)
     {
+        if (isUnixAddress(hostname))
+        {
+            std::vector<SocketAddress> addresses;
+            return resolveAddresses(hostname, port, addresses) and connectSocket(addresses, socketOut, timeoutMs, tuning);
+        }
         addrinfo* hostAddr = nullptr;
         if (!resolveHostname(hostname, false, hostAddr, port, true)) { return false; }
         SOCKET s = INVALID_SOCKET;
-        bool cr = connectSocket(hostAddr, s);
+        bool cr = connectSocket(hostAddr, s, timeoutMs, tuning);
         freeaddrinfo(hostAddr); // TODO: why was this commented out before?
         socketOut = s;
         return cr;
     }
 
-    size_t sendData(SOCKET& s, const char* data, const size_t& dataSize)
+    int64_t sendData(SOCKET s, const char* data, size_t dataSize)
+    {
+#ifdef MSG_NOSIGNAL
+        const auto bytesSent = send(s, data, dataSize, MSG_NOSIGNAL); // a closed peer is reported as an error, instead of raising SIGPIPE
+#else
+        const auto bytesSent = send(s, data, (int)dataSize, 0);
+#endif
+        return (bytesSent != SOCKET_ERROR) ? (int64_t)bytesSent : -1;
+    }
+
+    int64_t sendVectored(SOCKET s, const std::string_view* buffers, size_t count, uint32_t flags)
+    {
+        count = (count < ES_SEND_VECTOR_MAX) ? count : ES_SEND_VECTOR_MAX;
+#ifdef _WIN32
+        std::array<WSABUF, ES_SEND_VECTOR_MAX> wsaBuffers;
+        for (size_t i = 0; i < count; i++)
+        {
+            wsaBuffers[i].buf = const_cast<char*>(buffers[i].data());
+            wsaBuffers[i].len = (ULONG)buffers[i].size();
+        }
+        DWORD bytesSent = 0;
+        if (WSASend(s, wsaBuffers.data(), (DWORD)count, &bytesSent, 0, nullptr, nullptr) == SOCKET_ERROR)
+            return -1;
+        return (int64_t)bytesSent;
+#else
+        std::array<iovec, ES_SEND_VECTOR_MAX> iov;
+        for (size_t i = 0; i < count; i++)
+        {
+            iov[i].iov_base = const_cast<char*>(buffers[i].data());
+            iov[i].iov_len = buffers[i].size();
+        }
+        msghdr message{};
+        message.msg_iov = iov.data();
+        message.msg_iovlen = count;
+        int messageFlags = 0;
+    #ifdef MSG_NOSIGNAL
+        messageFlags |= MSG_NOSIGNAL; // a closed peer is reported as an error, instead of raising SIGPIPE
+    #endif
+    #ifdef MSG_MORE
+        messageFlags |= (flags & ES_SEND_MORE) ? MSG_MORE : 0;
+    #endif
+    #ifdef MSG_ZEROCOPY
+        messageFlags |= (flags & ES_SEND_ZEROCOPY) ? MSG_ZEROCOPY : 0;
+    #endif
+        return sendmsg(s, &message, messageFlags);
+#endif
+    }
+
+    bool enableKernelTlsSend([[maybe_unused]] SOCKET s, [[maybe_unused]] KernelTlsCipher cipher, [[maybe_unused]] const unsigned char* key,
+                             [[maybe_unused]] size_t keySize, [[maybe_unused]] const unsigned char* iv, [[maybe_unused]] size_t ivSize,
+                             [[maybe_unused]] uint64_t sequence)
+    {
+#ifdef ES_KERNEL_TLS
+        unsigned char recordSequence[8];
+        for (size_t i = 0; i < sizeof(recordSequence); i++)
+            recordSequence[i] = (unsigned char)(sequence >> (56 - 8 * i)); // big-endian
+
+        // GCM nonces are the implicit salt followed by an explicit part, which continues from the record sequence number
+        // as the user space library chose it, the kernel advances both together
+        auto fillGcm = [&](auto& info, uint16_t cipherType)
+        {
+            if (keySize != sizeof(info.key) or ivSize != sizeof(info.salt))
+                return false;
+            info.info.version = TLS_1_2_VERSION;
+            info.info.cipher_type = cipherType;
+            memcpy(info.key, key, keySize);
+            memcpy(info.salt, iv, ivSize);
+            memcpy(info.iv, recordSequence, sizeof(info.iv));
+            memcpy(info.rec_seq, recordSequence, sizeof(info.rec_seq));
+            return true;
+        };
+        union
+        {
+            tls12_crypto_info_aes_gcm_128 aes128;
+            tls12_crypto_info_aes_gcm_256 aes256;
+            tls12_crypto_info_chacha20_poly1305 chacha;
+        } info{};
+        size_t infoSize = 0;
+        bool filled = false;
+        switch (cipher)
+        {
+        case KernelTlsCipher::Aes128Gcm:
+            filled = fillGcm(info.aes128, TLS_CIPHER_AES_GCM_128);
+            infoSize = sizeof(info.aes128);
+            break;
+        case KernelTlsCipher::Aes256Gcm:
+            filled = fillGcm(info.aes256, TLS_CIPHER_AES_GCM_256);
+            infoSize = sizeof(info.aes256);
+            break;
+        case KernelTlsCipher::ChaCha20Poly1305:
+            // the whole nonce is implicit, xored with the sequence number
+            filled = (keySize == sizeof(info.chacha.key) and ivSize == sizeof(info.chacha.iv));
+            info.chacha.info.version = TLS_1_2_VERSION;
+            info.chacha.info.cipher_type = TLS_CIPHER_CHACHA20_POLY1305;
+            memcpy(info.chacha.key, key, std::min(keySize, sizeof(info.chacha.key)));
+            memcpy(info.chacha.iv, iv, std::min(ivSize, sizeof(info.chacha.iv)));
+            memcpy(info.chacha.rec_seq, recordSequence, sizeof(info.chacha.rec_seq));
+            infoSize = sizeof(info.chacha);
+            break;
+        }
+        const bool enabled = filled and setsockopt(s, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) == 0 and
+                             setsockopt(s, SOL_TLS, TLS_TX, &info, infoSize) == 0;
+        volatile unsigned char* wipe = reinterpret_cast<unsigned char*>(&info);
+        for (size_t i = 0; i < sizeof(info); i++)
+            wipe[i] = 0;
+        return enabled;
+#else
+        return false;
+#endif
+    }
+
+    bool enableZerocopy([[maybe_unused]] SOCKET s)
     {
-		const size_t bytesSent = send(s, data, dataSize, 0);
-		return (bytesSent != SOCKET_ERROR) ? bytesSent : 0;
+#if defined(__linux__) and defined(SO_ZEROCOPY)
+        const int enable = 1;
+        return setsockopt(s, SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(enable)) == 0;
+#else
+        return false;
+#endif
     }
 
-    bool createListenSocket(SOCKET& s, const std::string& port, const std::string& hostname)
+    bool readZerocopyCompletions([[maybe_unused]] SOCKET s, [[maybe_unused]] uint32_t& completedIdOut, [[maybe_unused]] bool& copiedOut)
     {
+#if defined(__linux__) and defined(SO_ZEROCOPY)
+        bool completed = false;
+        while (true)
+        {
+            alignas(cmsghdr) char control[128];
+            msghdr message{};
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+            if (recvmsg(s, &message, MSG_ERRQUEUE | MSG_DONTWAIT) == -1)
+                break; // error queue is empty
+            for (cmsghdr* header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header))
+            {
+                const bool isRecvErr = (header->cmsg_level == SOL_IP and header->cmsg_type == IP_RECVERR) or
+                                        (header->cmsg_level == SOL_IPV6 and header->cmsg_type == IPV6_RECVERR);
+                if (not isRecvErr)
+                    continue;
+                sock_extended_err error{};
+                memcpy(&error, CMSG_DATA(header), sizeof(error));
+                if (error.ee_origin != SO_EE_ORIGIN_ZEROCOPY or error.ee_errno != 0)
+                    continue;
+                // each notification covers the range of sends ee_info to ee_data, TCP completes them in order
+                completedIdOut = error.ee_data;
+                copiedOut = copiedOut or (error.ee_code & SO_EE_CODE_ZEROCOPY_COPIED);
+                completed = true;
+            }
+        }
+        return completed;
+#else
+        return false;
+#endif
+    }
+
+    int64_t sendFile([[maybe_unused]] SOCKET s, [[maybe_unused]] int fileDescriptor, [[maybe_unused]] uint64_t offset, [[maybe_unused]] size_t size)
+    {
+#ifdef __linux__
+        off_t fileOffset = (off_t)offset;
+        return sendfile(s, fileDescriptor, &fileOffset, size);
+#else
+        return -1;
+#endif
+    }
+
+    bool sendFileSupported()
+    {
+#ifdef __linux__
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    bool isUnixAddress(std::string_view hostname)
+    {
+        return hostname.substr(0, ES_UNIX_PREFIX.size()) == ES_UNIX_PREFIX;
+    }
+
+    bool unixSocketAddress(std::string_view hostname, SocketAddress& addressOut)
+    {
+        if (not isUnixAddress(hostname))
+            return false;
+        const std::string_view path = hostname.substr(ES_UNIX_PREFIX.size());
+        const bool abstract = not path.empty() and path[0] == '@';
+#ifndef __linux__
+        if (abstract)
+            return false;
+#endif
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        // paths are null terminated, abstract names start with a null byte instead and their length is given by the address size
+        const size_t pathSize = path.size() + (abstract ? 0 : 1);
+        if (path.empty() or pathSize > sizeof(address.sun_path))
+            return false;
+        memcpy(address.sun_path, path.data(), path.size());
+        if (abstract)
+            address.sun_path[0] = '\0';
+        addressOut = SocketAddress{};
+        addressOut.size = (socklen_t)(offsetof(sockaddr_un, sun_path) + pathSize);
+        memcpy(&addressOut.storage, &address, addressOut.size);
+        return true;
+    }
+
+    void removeUnixSocketFile(std::string_view hostname)
+    {
+        if (not isUnixAddress(hostname) or hostname.substr(ES_UNIX_PREFIX.size()).starts_with('@'))
+            return;
+        std::remove(std::string(hostname.substr(ES_UNIX_PREFIX.size())).c_str());
+    }
+
+    namespace
+    {
+        bool lastErrorAddressInUse()
+        {
+#ifdef _WIN32
+            return WSAGetLastError() == WSAEADDRINUSE;
+#else
+            return errno == EADDRINUSE;
+#endif
+        }
+
+        bool createUnixListenSocket(SOCKET& s, const std::string& hostname, int backlog, const SocketTuning& tuning,
+                                    SocketTuningReport* tuningReportOut)
+        {
+            SocketAddress address{};
+            if (not unixSocketAddress(hostname, address))
+                return false;
+            s = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (s == INVALID_SOCKET)
+                return false;
+            if (not tuning.isDefault())
+            {
+                SocketTuningReport report = applySocketTuning(s, tuning, SocketRole::Listen);
+                if (tuningReportOut)
+                    *tuningReportOut = std::move(report);
+            }
+            bool bound = (bind(s, (const sockaddr*)&address.storage, address.size) != SOCKET_ERROR);
+            if (not bound and lastErrorAddressInUse())
+            {
+                // the socket file may be left behind by a process that exited, it is only replaced if nothing accepts on it anymore
+                SOCKET probe = socket(AF_UNIX, SOCK_STREAM, 0);
+                const bool live = (probe != INVALID_SOCKET) and (connect(probe, (const sockaddr*)&address.storage, address.size) != SOCKET_ERROR);
+                closeSocket(probe);
+                if (not live)
+                {
+                    removeUnixSocketFile(hostname);
+                    bound = (bind(s, (const sockaddr*)&address.storage, address.size) != SOCKET_ERROR);
+                }
+            }
+            if (not bound or listen(s, backlog) == SOCKET_ERROR)
+            {
+                closeSocket(s);
+                s = INVALID_SOCKET;
+                return false;
+            }
+            return true;
+        }
+    }
+
+    bool createListenSocket(SOCKET& s, const std::string& port, const std::string& hostname, int backlog, bool reusePort,
+                            const SocketTuning& tuning, SocketTuningReport* tuningReportOut)
+    {
+        if (isUnixAddress(hostname))
+            return not reusePort and createUnixListenSocket(s, hostname, backlog, tuning, tuningReportOut);
         addrinfo* p = nullptr;
         if (!resolveHostname(hostname, true, p, port, true, true)) { return false; }
         s = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
         setsockopt(s, SOL_SOCKET, IPV6_V6ONLY, 0, sizeof(bool));
-        auto bound = (bind(s, p->ai_addr, (socklen_t)p->ai_addrlen) != SOCKET_ERROR);
-        auto listening = (listen(s, 100) != SOCKET_ERROR);
+        if (s != INVALID_SOCKET and not tuning.isDefault())
+        {
+            SocketTuningReport report = applySocketTuning(s, tuning, SocketRole::Listen);
+            if (tuningReportOut)
+                *tuningReportOut = std::move(report);
+        }
+        bool optionsSet = true;
+        if (reusePort)
+        {
+#ifdef SO_REUSEPORT
+            const int enable = 1;
+            optionsSet = (setsockopt(s, SOL_SOCKET, SO_REUSEPORT, (const char*)&enable, sizeof(enable)) != SOCKET_ERROR);
+#else
+            optionsSet = false;
+#endif
+        }
+        auto bound = optionsSet and (bind(s, p->ai_addr, (socklen_t)p->ai_addrlen) != SOCKET_ERROR);
+        auto listening = bound and (listen(s, backlog) != SOCKET_ERROR);
         freeaddrinfo(p);
         if (!bound || !listening || s == INVALID_SOCKET) { closeSocket(s); return false; }
         return true;
     }
 
+    bool reusePortSupported()
+    {
+#ifdef SO_REUSEPORT
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    bool setIncomingCpu(SOCKET listenSocket, int core)
+    {
+#ifdef SO_INCOMING_CPU
+        return setsockopt(listenSocket, SOL_SOCKET, SO_INCOMING_CPU, (const char*)&core, sizeof(core)) != SOCKET_ERROR;
+#else
+        return false;
+#endif
+    }
+
+    SOCKET acceptConnection(SOCKET listenSocket)
+    {
+#ifdef __linux__
+        return accept4(listenSocket, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+        SOCKET s = accept(listenSocket, nullptr, nullptr);
+        if (s != INVALID_SOCKET)
+            setBlocking(s, false);
+        return s;
+#endif
+    }
+
     int32_t receiveData(SOCKET& s, char* outBuffer, size_t bufSize)
     { 
         return recv(s, outBuffer, bufSize, MSG_WAITALL); 
     }
 
+    int32_t receiveAvailable(SOCKET& s, char* outBuffer, size_t bufSize)
+    {
+        return recv(s, outBuffer, bufSize, 0);
+    }
+
+    int64_t receiveVectored(SOCKET s, const std::span<char>* buffers, size_t count)
+    {
+        count = (count < ES_RECEIVE_VECTOR_MAX) ? count : ES_RECEIVE_VECTOR_MAX;
+#ifdef _WIN32
+        std::array<WSABUF, ES_RECEIVE_VECTOR_MAX> wsaBuffers;
+        for (size_t i = 0; i < count; i++)
+        {
+            wsaBuffers[i].buf = buffers[i].data();
+            wsaBuffers[i].len = (ULONG)buffers[i].size();
+        }
+        DWORD bytesReceived = 0;
+        DWORD flags = 0;
+        if (WSARecv(s, wsaBuffers.data(), (DWORD)count, &bytesReceived, &flags, nullptr, nullptr) == SOCKET_ERROR)
+            return -1;
+        return (int64_t)bytesReceived;
+#else
+        std::array<iovec, ES_RECEIVE_VECTOR_MAX> iov;
+        for (size_t i = 0; i < count; i++)
+        {
+            iov[i].iov_base = buffers[i].data();
+            iov[i].iov_len = buffers[i].size();
+        }
+        msghdr message{};
+        message.msg_iov = iov.data();
+        message.msg_iovlen = count;
+        return recvmsg(s, &message, 0);
+#endif
+    }
+
     int32_t receiveData_CL(SOCKET& s, char& outBuffer, const size_t& bufSize,
                     sockaddr& srcAddrOut, size_t& srcAddrLenOut)
     { 
         return recvfrom(s, &outBuffer, bufSize, 0, &srcAddrOut, (socklen_t*)&srcAddrLenOut); 
     }
 
+    std::string SocketAddress::toString() const
+    {
+        if (storage.ss_family == AF_UNIX)
+        {
+            const auto* address = reinterpret_cast<const sockaddr_un*>(&storage);
+            const size_t offset = offsetof(sockaddr_un, sun_path);
+            if (size <= offset)
+                return std::string(ES_UNIX_PREFIX); // unnamed, such as the client end of a connection
+            if (address->sun_path[0] == '\0')
+                return std::string(ES_UNIX_PREFIX) + "@" + std::string(address->sun_path + 1, size - offset - 1);
+            return std::string(ES_UNIX_PREFIX) + address->sun_path;
+        }
+        char host[INET6_ADDRSTRLEN]{};
+        uint16_t port = 0;
+        if (storage.ss_family == AF_INET)
+        {
+            const auto* address = reinterpret_cast<const sockaddr_in*>(&storage);
+            inet_ntop(AF_INET, &address->sin_addr, host, sizeof(host));
+            port = ntohs(address->sin_port);
+        }
+        else if (storage.ss_family == AF_INET6)
+        {
+            const auto* address = reinterpret_cast<const sockaddr_in6*>(&storage);
+            inet_ntop(AF_INET6, &address->sin6_addr, host, sizeof(host));
+            port = ntohs(address->sin6_port);
+        }
+        return std::string(host) + ":" + std::to_string(port);
+    }
+
+    bool resolveDatagramAddress(const std::string& hostname, const std::string& port, SocketAddress& addressOut)
+    {
+        addrinfo hints{};
+        hints.ai_socktype = SOCK_DGRAM;
+        hints.ai_protocol = IPPROTO_UDP;
+        hints.ai_family = AF_UNSPEC;
+        addrinfo* result = nullptr;
+        if (getaddrinfo(hostname.empty() ? nullptr : hostname.c_str(), port.c_str(), &hints, &result) != 0 or not result)
+            return false;
+        memcpy(&addressOut.storage, result->ai_addr, result->ai_addrlen);
+        addressOut.size = (socklen_t)result->ai_addrlen;
+        freeaddrinfo(result);
+        return true;
+    }
+
+    bool createDatagramSocket(SOCKET& s, const std::string& port, const std::string& hostname)
+    {
+        addrinfo hints{};
+        hints.ai_socktype = SOCK_DGRAM;
+        hints.ai_protocol = IPPROTO_UDP;
+        hints.ai_family = hostname.empty() ? AF_INET : AF_UNSPEC;
+        hints.ai_flags = AI_PASSIVE;
+        addrinfo* p = nullptr;
+        if (getaddrinfo(hostname.empty() ? nullptr : hostname.c_str(), port.c_str(), &hints, &p) != 0 or not p)
+            return false;
+        s = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+        const bool bound = (s != INVALID_SOCKET) and (bind(s, p->ai_addr, (socklen_t)p->ai_addrlen) != SOCKET_ERROR);
+        freeaddrinfo(p);
+        if (not bound)
+        {
+            closeSocket(s);
+            s = INVALID_SOCKET;
+            return false;
+        }
+        setBlocking(s, false);
+        return true;
+    }
+
+    int32_t receiveDatagrams(SOCKET s, DatagramMessage* messages, size_t count)
+    {
+        count = (count < ES_DATAGRAM_BATCH_MAX) ? count : ES_DATAGRAM_BATCH_MAX;
+#ifdef __linux__
+        std::array<mmsghdr, ES_DATAGRAM_BATCH_MAX> headers{};
+        std::array<iovec, ES_DATAGRAM_BATCH_MAX> iov;
+        std::array<std::array<char, CMSG_SPACE(sizeof(int))>, ES_DATAGRAM_BATCH_MAX> control;
+        for (size_t i = 0; i < count; i++)
+        {
+            iov[i] = iovec{ messages[i].data, messages[i].size };
+            msghdr& message = headers[i].msg_hdr;
+            message.msg_iov = &iov[i];
+            message.msg_iovlen = 1;
+            message.msg_name = &messages[i].address->storage;
+            message.msg_namelen = sizeof(sockaddr_storage);
+            message.msg_control = control[i].data();
+            message.msg_controllen = control[i].size();
+        }
+        const int received = recvmmsg(s, headers.data(), (unsigned int)count, MSG_DONTWAIT, nullptr);
+        for (int i = 0; i < received; i++)
+        {
+            messages[i].size = headers[i].msg_len;
+            messages[i].address->size = headers[i].msg_hdr.msg_namelen;
+            messages[i].segmentSize = 0;
+            // coalesced datagrams (UDP_GRO) carry the size of the original datagrams
+            for (cmsghdr* header = CMSG_FIRSTHDR(&headers[i].msg_hdr); header; header = CMSG_NXTHDR(&headers[i].msg_hdr, header))
+            {
+                if (header->cmsg_level == SOL_UDP and header->cmsg_type == UDP_GRO)
+                {
+                    int segmentSize = 0;
+                    memcpy(&segmentSize, CMSG_DATA(header), sizeof(segmentSize));
+                    messages[i].segmentSize = (uint16_t)segmentSize;
+                }
+            }
+        }
+        return received;
+#else
+        int32_t received = 0;
+        for (; received < (int32_t)count; received++)
+        {
+            DatagramMessage& message = messages[received];
+            socklen_t addressSize = sizeof(sockaddr_storage);
+            const int size = recvfrom(s, message.data, (int)message.size, 0, (sockaddr*)&message.address->storage, &addressSize);
+            if (size < 0)
+                break;
+            message.size = (size_t)size;
+            message.address->size = addressSize;
+            message.segmentSize = 0;
+        }
+        return (received > 0) ? received : -1;
+#endif
+    }
+
+    int32_t sendDatagrams(SOCKET s, const DatagramMessage* messages, size_t count)
+    {
+        count = (count < ES_DATAGRAM_BATCH_MAX) ? count : ES_DATAGRAM_BATCH_MAX;
+#ifdef __linux__
+        std::array<mmsghdr, ES_DATAGRAM_BATCH_MAX> headers{};
+        std::array<iovec, ES_DATAGRAM_BATCH_MAX> iov;
+        std::array<std::array<char, CMSG_SPACE(sizeof(uint16_t))>, ES_DATAGRAM_BATCH_MAX> control{};
+        for (size_t i = 0; i < count; i++)
+        {
+            iov[i] = iovec{ messages[i].data, messages[i].size };
+            msghdr& message = headers[i].msg_hdr;
+            message.msg_iov = &iov[i];
+            message.msg_iovlen = 1;
+            message.msg_name = &messages[i].address->storage;
+            message.msg_namelen = messages[i].address->size;
+            if (messages[i].segmentSize > 0 and messages[i].size > messages[i].segmentSize)
+            {
+                message.msg_control = control[i].data();
+                message.msg_controllen = control[i].size();
+                cmsghdr* header = CMSG_FIRSTHDR(&message);
+                header->cmsg_level = SOL_UDP;
+                header->cmsg_type = UDP_SEGMENT;
+                header->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                memcpy(CMSG_DATA(header), &messages[i].segmentSize, sizeof(uint16_t));
+            }
+        }
+        return sendmmsg(s, headers.data(), (unsigned int)count, MSG_DONTWAIT | MSG_NOSIGNAL);
+#else
+        int32_t sent = 0;
+        for (; sent < (int32_t)count; sent++)
+        {
+            const DatagramMessage& message = messages[sent];
+            if (sendto(s, message.data, (int)message.size, 0, (const sockaddr*)&message.address->storage, message.address->size) == SOCKET_ERROR)
+                break;
+        }
+        return (sent > 0) ? sent : -1;
+#endif
+    }
+
+    bool datagramSegmentationSupported([[maybe_unused]] SOCKET s)
+    {
+#ifdef __linux__
+        int segmentSize = 0;
+        socklen_t optionSize = sizeof(segmentSize);
+        return getsockopt(s, SOL_UDP, UDP_SEGMENT, &segmentSize, &optionSize) == 0;
+#else
+        return false;
+#endif
+    }
+
+    bool enableDatagramCoalescing([[maybe_unused]] SOCKET s)
+    {
+#ifdef __linux__
+        const int enable = 1;
+        return setsockopt(s, SOL_UDP, UDP_GRO, &enable, sizeof(enable)) == 0;
+#else
+        return false;
+#endif
+    }
+
     long getReceiveSize(SOCKET s)
     {
 #ifdef _WIN32
@@ -131,6 +977,15 @@ namespace Sockets
         return r;
     }
 
+    bool lastErrorWouldBlock()
+    {
+#ifdef _WIN32
+        return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+        return (errno == EAGAIN) or (errno == EWOULDBLOCK) or (errno == EINTR);
+#endif
+    }
+
 	bool setReceiveTimeout(SOCKET socketFd, int timeoutMs) 
 	{
 #ifdef _WIN32
@@ -164,12 +1019,12 @@ namespace Sockets
     std::string getAddrAsString(addrinfo* ai)
     {
         if (!ai) { return std::string(); }
-        char* addrStr = new char[46];
+        char addrStr[INET6_ADDRSTRLEN]{};
+        const void* address = (ai->ai_family == AF_INET6) ? (const void*)&((struct sockaddr_in6*)ai->ai_addr)->sin6_addr
+                                                          : (const void*)&((struct sockaddr_in*)ai->ai_addr)->sin_addr;
         // inet_ntop() should convert the address from network-byte-order to host-byte-order
-        inet_ntop(ai->ai_family, &((struct sockaddr_in*)ai->ai_addr)->sin_addr, addrStr, 46);
-        std::string str = std::string(addrStr, strlen(addrStr));
-        delete[] addrStr;
-        return str;
+        inet_ntop(ai->ai_family, address, addrStr, sizeof(addrStr));
+        return std::string(addrStr);
     }
     void threadSleep(int milliseconds)
     {
@@ -5,6 +5,7 @@
 #ifdef _WIN32
 	#include <winsock2.h>
 	#include <ws2tcpip.h>
+	#include <afunix.h>
 	#pragma comment(lib, "Ws2_32.lib")
 #else
 	#include <sys/socket.h>
@@ -12,12 +13,16 @@
 	#include <netdb.h>
 	#include <unistd.h>
 	#include <arpa/inet.h>
+	#include <sys/un.h>
 #endif
 
 // contains macros to enable cross-compilation of socket code
 #include "PlatformMacros.h" 
 
 #include <string>
+#include <string_view>
+#include <span>
+#include <vector>
 #include <mutex>
 #include <iostream>
 
@@ -31,34 +36,215 @@ namespace Sockets
 	bool cleanup();
 	size_t& socketsInitCounter();
 
+	// an IPv4 or IPv6 address and port, such as a connection candidate or a datagram sender
+	struct SocketAddress
+	{
+		sockaddr_storage storage{};
+		socklen_t size = 0;
+		int family() const { return storage.ss_family; }
+		std::string toString() const; // "address:port", or "unix:path" for unix domain sockets
+	};
+
+	// hostnames starting with this prefix name a unix domain socket path instead of a TCP host, the port is ignored
+	// "unix:@name" is a socket in the abstract namespace, which has no file and disappears with the socket (Linux only)
+	constexpr std::string_view ES_UNIX_PREFIX = "unix:";
+	bool isUnixAddress(std::string_view hostname);
+	// converts a "unix:" hostname to a unix domain socket address, returns false if the path is too long or not supported
+	bool unixSocketAddress(std::string_view hostname, SocketAddress& addressOut);
+	// removes the socket file a unix domain listen socket was bound to, nothing to do for the abstract namespace
+	void removeUnixSocketFile(std::string_view hostname);
+
+	// kinds of traffic the socket options of a tuning profile are chosen for
+	enum class SocketProfile
+	{
+		Default, // system defaults, no options are changed
+		Latency, // small request/response exchanges: no Nagle delay, busy polling, TCP Fast Open, deferred accept
+		Throughput, // large responses over many connections: no Nagle delay, larger fixed socket buffers, deferred accept
+		Bulk // few long transfers: Nagle coalescing and large socket buffers
+	};
+
+	// performance-relevant socket options, zero leaves an option at the system default
+	struct SocketTuning
+	{
+		bool noDelay = false; // TCP_NODELAY, send small writes immediately instead of coalescing them
+		int deferAcceptSec = 0; // TCP_DEFER_ACCEPT, listen sockets only hand over connections once data arrives (Linux)
+								// only suits protocols where the client sends first, such as HTTP
+		int fastOpenQueue = 0; // TCP_FASTOPEN, listen sockets accept data in the SYN, clients send it (TCP_FASTOPEN_CONNECT)
+		int sendBufferSize = 0; // SO_SNDBUF (bytes), a fixed size disables the kernel's automatic sizing
+		int receiveBufferSize = 0; // SO_RCVBUF (bytes), set on the listen socket so the window scale of accepted connections covers it
+		int busyPollUs = 0; // SO_BUSY_POLL, receives spin on the device queue instead of sleeping (Linux)
+
+		static SocketTuning fromProfile(SocketProfile profile);
+		bool isDefault() const;
+	};
+
+	// where in a connection's life the options are applied, each role uses the options relevant to it
+	enum class SocketRole { Listen, Accepted, Connecting };
+
+	// which of the requested options took effect, and their values as read back from the socket
+	struct SocketTuningReport
+	{
+		struct Option
+		{
+			std::string name;
+			int requested = 0;
+			int effective = 0; // the kernel may adjust values, such as doubling buffer sizes on Linux
+			bool applied = false;
+			std::string error{};
+		};
+		std::vector<Option> options;
+
+		bool allApplied() const;
+		std::string toString() const; // one line, such as "TCP_NODELAY=1 SO_SNDBUF=1048576 (effective 2097152)"
+	};
+
+	// sets the options of the tuning that apply to the role, returns which of them took effect
+	SocketTuningReport applySocketTuning(SOCKET s, const SocketTuning& tuning, SocketRole role);
+	// reads back the current values of the options of the tuning that apply to the role, without changing them
+	SocketTuningReport readSocketTuning(SOCKET s, const SocketTuning& tuning, SocketRole role);
+	// returns true if accepted TCP sockets inherit the tuned options of their listen socket, so they need not be set again (Linux)
+	bool socketTuningInherited();
+
 	// resolves address from hostname, remember to use freeaddrinfo() on the result, empty hostname returns localhost
+	// client lookups return both IPv4 and IPv6 addresses in the order preferred by the system, listen sockets use IPv4
 	bool resolveHostname(const std::string& hostname, bool numericHost, addrinfo*& addrOut,
 						const std::string& port, bool numericPort, bool listenSocket = false);
 
+	// time each connection attempt gets to complete before the next address is tried in parallel (RFC 8305 "Connection Attempt Delay")
+	constexpr int ES_CONNECT_ATTEMPT_DELAY_MS = 250;
+
 	// attempts to open a client socket and connect, remember to close the socket
-	bool connectSocket(struct addrinfo*& addr, SOCKET& socketOut);
+	// addresses are tried in parallel with staggered starts, alternating between IPv6 and IPv4 (Happy Eyeballs, RFC 8305)
+	// the first connection to succeed is kept and returned as a blocking socket, the attempts still in progress are abandoned
+	bool connectSocket(struct addrinfo*& addr, SOCKET& socketOut, int timeoutMs = 3000, const SocketTuning& tuning = {});
+	bool connectSocket(const std::vector<SocketAddress>& addresses, SOCKET& socketOut, int timeoutMs = 3000, const SocketTuning& tuning = {});
+
+	// resolves the TCP addresses of a client hostname (blocking), in the order preferred by the system, or the unix socket address
+	bool resolveAddresses(const std::string& hostname, const std::string& port, std::vector<SocketAddress>& addressesOut);
 
-	// handles both hostname resolution and socket creation, establishes client-to-server TCP connection
-	bool setupStream(const std::string& hostname, const std::string& port, SOCKET& socketOut);
+	// handles both hostname resolution and socket creation, establishes client-to-server TCP or unix domain socket connection
+	bool setupStream(const std::string& hostname, const std::string& port, SOCKET& socketOut, int timeoutMs = 3000,
+					const SocketTuning& tuning = {});
 	
-	// sends data over a socket
-	size_t sendData(SOCKET& s, const char* data, const size_t& dataSize);
+	// sends data over a socket, returns the number of bytes sent, which may be less than dataSize when the socket buffer is full,
+	// or -1 on error, a non-blocking socket that cannot accept any data fails with lastErrorWouldBlock
+	int64_t sendData(SOCKET s, const char* data, size_t dataSize);
+
+	// maximum number of buffers passed to sendVectored in one call
+	constexpr size_t ES_SEND_VECTOR_MAX = 64;
 
-	bool createListenSocket(SOCKET& s, const std::string& port, const std::string& hostname = std::string());
+	// flags for sendVectored
+	enum SendFlags : uint32_t
+	{
+		ES_SEND_MORE = 1 << 0, // more data is sent right after, so a short header is not sent as a packet of its own (MSG_MORE)
+		ES_SEND_ZEROCOPY = 1 << 1 // the kernel sends from the buffers without copying them, see enableZerocopy (MSG_ZEROCOPY)
+	};
+
+	// sends several buffers with a single call (sendmsg/WSASend), without first copying them into one buffer
+	// returns the number of bytes sent, which may end in the middle of any buffer, or -1 on error (see lastErrorWouldBlock)
+	int64_t sendVectored(SOCKET s, const std::string_view* buffers, size_t count, uint32_t flags = 0);
+
+	// allows ES_SEND_ZEROCOPY sends on a socket, returns false if not supported (Linux only)
+	// the buffers of a zerocopy send must not be modified or freed until the kernel reports the send as complete
+	bool enableZerocopy(SOCKET s);
+	// reads zerocopy completion notifications from the socket error queue without blocking
+	// successful zerocopy sends are numbered in order starting from 0, completedIdOut receives the number of the last completed send
+	// copiedOut is set if the kernel copied the data after all (such as over loopback), in which case zerocopy only adds overhead
+	// returns false if no notifications were available
+	bool readZerocopyCompletions(SOCKET s, uint32_t& completedIdOut, bool& copiedOut);
+
+	// sends part of a file directly from the kernel page cache, without copying it through user space (Linux only)
+	// returns the number of bytes sent, or -1 on error (see lastErrorWouldBlock)
+	int64_t sendFile(SOCKET s, int fileDescriptor, uint64_t offset, size_t size);
+	bool sendFileSupported();
+
+	// record ciphers the kernel can encrypt TLS 1.2 records with
+	enum class KernelTlsCipher { Aes128Gcm, Aes256Gcm, ChaCha20Poly1305 };
+	// hands encryption of outgoing TLS 1.2 records to the kernel (kTLS, Linux only), returns false if not available
+	// data sent on the socket afterwards, including sendFile, leaves as encrypted application data records
+	// every record encrypted in user space must have been sent before, key and iv are the write key and implicit nonce of this side,
+	// sequence is the number of the next record
+	bool enableKernelTlsSend(SOCKET s, KernelTlsCipher cipher, const unsigned char* key, size_t keySize,
+							 const unsigned char* iv, size_t ivSize, uint64_t sequence);
+
+	// reusePort allows several listen sockets to bind the same port, the kernel spreads new connections between them (not available on Windows)
+	// the tuning is applied before the socket starts listening, so options such as TCP_FASTOPEN and buffer sizes take effect
+	// a "unix:" hostname binds a unix domain socket instead, replacing a stale socket file left at the path, reusePort is not supported
+	bool createListenSocket(SOCKET& s, const std::string& port, const std::string& hostname = std::string(),
+							int backlog = 100, bool reusePort = false, const SocketTuning& tuning = {},
+							SocketTuningReport* tuningReportOut = nullptr);
+
+	// returns true if createListenSocket supports reusePort on this platform
+	bool reusePortSupported();
+
+	// has the kernel prefer this listen socket for connections whose packets it receives on the core (SO_INCOMING_CPU, Linux only)
+	// among listen sockets sharing a port with reusePort, each set to a different core, connections stay on the core that received them
+	bool setIncomingCpu(SOCKET listenSocket, int core);
+
+	// accepts one pending connection from a non-blocking listen socket, the new socket is non-blocking and close-on-exec
+	// returns INVALID_SOCKET when no connection is pending (lastErrorWouldBlock) or accepting failed
+	SOCKET acceptConnection(SOCKET listenSocket);
 
 	// receive (TCP), this is a blocking call
 	int32_t receiveData(SOCKET& s, char* outBuffer, size_t bufSize);
 
+	// receive (TCP) whatever is available without waiting for the full size, for use with non-blocking sockets
+	int32_t receiveAvailable(SOCKET& s, char* outBuffer, size_t bufSize);
+
+	// maximum number of buffers passed to receiveVectored in one call
+	constexpr size_t ES_RECEIVE_VECTOR_MAX = 16;
+
+	// receives whatever is available into several buffers with a single call (recvmsg/WSARecv), filling them in order
+	// returns the number of bytes received, 0 if the peer closed the connection, or -1 on error (see lastErrorWouldBlock)
+	int64_t receiveVectored(SOCKET s, const std::span<char>* buffers, size_t count);
+
 	// connectionless receive (UDP)
 	int32_t receiveData_CL(SOCKET& s, char& outBuffer, const size_t& bufSize,
 						struct sockaddr& srcAddrOut, size_t& srcAddrLenOut);
 
+	// resolves a hostname and port to an address datagrams can be sent to
+	bool resolveDatagramAddress(const std::string& hostname, const std::string& port, SocketAddress& addressOut);
+
+	// creates a non-blocking UDP socket bound to the port, an empty hostname binds all local interfaces
+	bool createDatagramSocket(SOCKET& s, const std::string& port, const std::string& hostname = std::string());
+
+	// one datagram, or with a segment size a run of equally sized datagrams to or from one address (UDP GSO/GRO)
+	struct DatagramMessage
+	{
+		char* data = nullptr;
+		size_t size = 0; // receive: capacity on input, received size on output
+		SocketAddress* address = nullptr;
+		uint16_t segmentSize = 0; // 0 for a single datagram, the last segment may be shorter
+	};
+
+	// maximum number of messages passed to receiveDatagrams or sendDatagrams in one call
+	constexpr size_t ES_DATAGRAM_BATCH_MAX = 64;
+	// maximum number of datagrams in one message with a segment size (kernel limit for UDP_SEGMENT)
+	constexpr size_t ES_DATAGRAM_SEGMENTS_MAX = 64;
+
+	// receives up to count datagrams with a single call (recvmmsg), for use with non-blocking sockets
+	// returns the number of messages received, or -1 on error (see lastErrorWouldBlock)
+	int32_t receiveDatagrams(SOCKET s, DatagramMessage* messages, size_t count);
+
+	// sends up to count messages with a single call (sendmmsg), messages with a segment size are split by the kernel (UDP_SEGMENT)
+	// returns the number of messages sent, or -1 on error (see lastErrorWouldBlock)
+	int32_t sendDatagrams(SOCKET s, const DatagramMessage* messages, size_t count);
+
+	// returns true if sendDatagrams can send messages with a segment size on this socket (Linux only)
+	bool datagramSegmentationSupported(SOCKET s);
+
+	// lets the kernel coalesce received datagrams of one flow into a single message with a segment size (UDP_GRO, Linux only)
+	bool enableDatagramCoalescing(SOCKET s);
+
 	// gets the size of data available to be received, without blocking
 	long getReceiveSize(SOCKET s);
 
 	// switches the socket to either blocking or non-blocking mode
 	int32_t setBlocking(SOCKET s, bool block);
 
+	// returns true if the last failed socket call on this thread only failed because a non-blocking socket was not ready
+	bool lastErrorWouldBlock();
+
 	bool setReceiveTimeout(SOCKET socketFd, int timeoutMs);
 
 	// shuts a connection down, flag can be one of: 0 (SD_RECEIVE), 1 (SD_SEND), 2 (SD_BOTH)